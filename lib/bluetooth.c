@@ -6,9 +6,16 @@
 #include <stdio.h>
 #include <string.h>
 
-#include <avr/interrupt.h>
-
 #include "bluetooth_settings.h"
+
+// Use the virtual registers when the library is built for the host simulation
+#if BT_HOST_SIMULATION
+    #include "bluetooth_host.h"
+#else
+    #include <avr/interrupt.h>
+    #include <avr/sleep.h>
+#endif
+
 #include "bluetooth_internal.h"
 #include "bluetooth.h"
 
@@ -31,12 +38,55 @@
 // This global tracks whether we've completed enough connection polls to determine
 // if we're connected to a remote device (start at 4, when we hit 0 we can finish setup)
 volatile static uint8_t uartInitialConnectionCheckCountdown = 4;
-// This global gets incremented every millisecond to allow for timeouts (set to 0 then count until desired)
+// This global gets incremented every millisecond to allow for timeouts (save its value, then wait until it has counted far enough)
 volatile static uint32_t uartMillisecondCounter = 0;
 // These two arrays serve as the command and response buffers for all AT commands
 // Allow for the configuration function toggle
 #if BT_ENABLE_CONFIGURATION_FUNCTIONS
     static char commandBuffer[20], responseBuffer[20];
+
+    // These globals track the AT command currently being carried out by bt_atPoll()
+    // The current step of the command (see BT_AT_STATE_*), and its result (see BT_AT_*)
+    static uint8_t        atState = BT_AT_STATE_IDLE;
+    static uint8_t        atResult = BT_AT_IDLE;
+    // The rest of the command to send, and the response (or response prefix, for queries) expected
+    static const char*    atCommand;
+    static const char*    atExpected;
+    // The buffer to store the response to a query in (NULL if the command isn't a query)
+    static char*          atQueryBuffer;
+    static size_t         atQueryBufferLength;
+    // The length of the response stored for a query (or -1 if the response didn't have the expected prefix)
+    static size_t         atQueryLength;
+    // The response received so far (and 1 if it was too long to fit in the buffer)
+    static char           atResponse[BT_AT_RESPONSE_BUFFER_LENGTH + 1];
+    static size_t         atResponseLength;
+    static uint8_t        atResponseOverflow;
+    // The millisecond count when the current step started (for timeouts)
+    static uint32_t       atStepStart;
+    // The function to call when a command completes, and the options for the current command (see BT_AT_FLAG_*)
+    static bt_at_callback atCallback = NULL;
+    static uint8_t        atFlags;
+
+    // These globals hold the settings collected by the bt_config* functions until bt_configCommit() sends them
+    // Each bit is set if the matching setting has been collected (see BT_CONFIG_SETTING_*)
+    static uint8_t        configPendingSettings = 0;
+    static char           configModuleName[13], configModulePIN[7];
+    static uint8_t        configAuthenticationType;
+
+    // The baud rates supported by the module (the index of each one is the value used for it by the AT+BAUD command)
+    static const uint32_t atBaudRates[] = { 9600, 19200, 38400, 57600, 115200, 4800, 2400, 1200, 230400 };
+    #define BT_AT_BAUD_RATE_COUNT (sizeof(atBaudRates) / sizeof(atBaudRates[0]))
+
+    // Allow for the configuration cache toggle
+    #if BT_ENABLE_CONFIGURATION_CACHE
+        // These globals hold the settings last read from/written to the module
+        // Each bit is set if the matching setting is cached (see BT_CONFIG_SETTING_*)
+        static uint8_t    cacheValidSettings = 0;
+        static char       cacheModuleName[13], cacheModulePIN[7], cacheAuthenticationType[2], cacheMACAddress[13];
+    #endif
+
+    // This function waits for the current command to complete
+    static uint8_t bt_atAwait();
 #endif
 
 uint8_t bt_setup() {
@@ -47,7 +97,15 @@ uint8_t bt_setup() {
     sei();
 
     // Wait until the initial connection status of the module has been determined
-    while (uartInitialConnectionCheckCountdown);
+    while (uartInitialConnectionCheckCountdown)
+        bt_uartWait();
+
+    // Find the baud rate that the module is using (this can only be done while it isn't
+    // connected to a remote device, since it won't respond to AT commands otherwise)
+    #if BT_ENABLE_AUTO_BAUD_RATE
+        if (!bt_connected() && !bt_detectBaudRate())
+            return 0;
+    #endif
 
     return 1;
 }
@@ -55,6 +113,152 @@ uint8_t bt_setup() {
 // Allow for the configuration function toggle
 #if BT_ENABLE_CONFIGURATION_FUNCTIONS
 
+    uint32_t bt_detectBaudRate() {
+        uint32_t originalBaudRate = bt_getUARTBaudRate();
+
+        // Try each of the module's baud rates, starting with the fastest
+        uint32_t previousBaudRate = UINT32_MAX;
+        while (1) {
+            // Find the fastest baud rate that hasn't been tried yet
+            uint32_t baudRate = 0;
+            for (uint8_t value = 0; value < BT_AT_BAUD_RATE_COUNT; value++) {
+                if (atBaudRates[value] < previousBaudRate && atBaudRates[value] > baudRate)
+                    baudRate = atBaudRates[value];
+            }
+            if (baudRate == 0)
+                break;
+            previousBaudRate = baudRate;
+
+            // Skip baud rates that the library can't use
+            if (!bt_setUARTBaudRate(baudRate))
+                continue;
+
+            // Discard anything received at the last baud rate, then ping the module
+            bt_flush();
+            if (bt_test())
+                return baudRate;
+        }
+
+        // The module didn't respond at any baud rate, so go back to the original one
+        bt_setUARTBaudRate(originalBaudRate);
+        bt_flush();
+        return 0;
+    }
+
+    /*
+    * --------------------------------------------------------------------------
+    * These functions keep a copy of the module's settings to avoid AT commands:
+    * --------------------------------------------------------------------------
+    */
+
+    // Allow for the configuration cache toggle
+    #if BT_ENABLE_CONFIGURATION_CACHE
+
+        // This function finds the cached copy of a setting (and the size of its buffer)
+        static char* bt_cacheValue(const uint8_t setting, size_t* length) {
+            switch (setting) {
+                case BT_CONFIG_SETTING_NAME:
+                    *length = sizeof(cacheModuleName);
+                    return cacheModuleName;
+                case BT_CONFIG_SETTING_PIN:
+                    *length = sizeof(cacheModulePIN);
+                    return cacheModulePIN;
+                case BT_CONFIG_SETTING_AUTHENTICATION_TYPE:
+                    *length = sizeof(cacheAuthenticationType);
+                    return cacheAuthenticationType;
+                default:
+                    *length = sizeof(cacheMACAddress);
+                    return cacheMACAddress;
+            }
+        }
+
+    #endif
+
+    // This function runs a query for a setting, answering it from the cache if the setting is cached
+    // (and caching the response otherwise)
+    static size_t bt_cachedQuery(const uint8_t setting, const char* command, const char* expectedResponsePrefix, char* buffer, size_t bufferLength) {
+        #if BT_ENABLE_CONFIGURATION_CACHE
+            size_t cacheLength;
+            char* cache = bt_cacheValue(setting, &cacheLength);
+
+            // If the setting isn't cached yet, query it from the module
+            if (!(cacheValidSettings & setting)) {
+                size_t responseLength = bt_sendATQuery(command, expectedResponsePrefix, cache, cacheLength);
+                // If the query failed, there's nothing to cache
+                if (responseLength == 0 || responseLength == (size_t) -1) {
+                    buffer[0] = '\0';
+                    return responseLength;
+                }
+                cacheValidSettings |= setting;
+            }
+
+            // Copy the cached setting into the provided buffer
+            size_t bufferEnd = min(strlen(cache), bufferLength - 1);
+            memcpy(buffer, cache, bufferEnd);
+            buffer[bufferEnd] = '\0';
+            return bufferEnd;
+        #else
+            (void) setting;
+            return bt_sendATQuery(command, expectedResponsePrefix, buffer, bufferLength);
+        #endif
+    }
+
+    // This function determines if a setting is cached with the given value
+    static uint8_t bt_cacheMatches(const uint8_t setting, const char* value) {
+        #if BT_ENABLE_CONFIGURATION_CACHE
+            size_t cacheLength;
+            return (cacheValidSettings & setting) && strcmp(bt_cacheValue(setting, &cacheLength), value) == 0;
+        #else
+            (void) setting;
+            (void) value;
+            return 0;
+        #endif
+    }
+
+    // This function updates the cache after a setting has been changed (or forgets the setting if the change failed)
+    static void bt_cacheUpdate(const uint8_t setting, const char* value, const uint8_t success) {
+        #if BT_ENABLE_CONFIGURATION_CACHE
+            if (success) {
+                size_t cacheLength;
+                char* cache = bt_cacheValue(setting, &cacheLength);
+                strncpy(cache, value, cacheLength - 1);
+                cache[cacheLength - 1] = '\0';
+                cacheValidSettings |= setting;
+            } else {
+                cacheValidSettings &= ~setting;
+            }
+        #else
+            (void) setting;
+            (void) value;
+            (void) success;
+        #endif
+    }
+
+    // Allow for the configuration cache toggle
+    #if BT_ENABLE_CONFIGURATION_CACHE
+
+        uint8_t bt_refreshConfiguration() {
+            // Forget the cached settings, then read each of them again (each one is cached as it's read)
+            bt_invalidateConfiguration();
+            uint8_t type;
+            bt_getModuleName(responseBuffer, sizeof(responseBuffer));
+            bt_getModulePIN(responseBuffer, sizeof(responseBuffer));
+            bt_getMACAddress(responseBuffer, sizeof(responseBuffer));
+            bt_getAuthenticationType(&type);
+
+            // Check that every setting was read
+            return cacheValidSettings == BT_CONFIG_SETTING_ALL;
+        }
+
+    #endif
+
+    void bt_invalidateConfiguration() {
+        // The MAC address is built into the module, so it never needs to be read again
+        #if BT_ENABLE_CONFIGURATION_CACHE
+            cacheValidSettings &= BT_CONFIG_SETTING_MAC_ADDRESS;
+        #endif
+    }
+
     /*
     * -------------------------------------------------------------------
     * These functions DO NOT need to be run each time the module is used:
@@ -63,24 +267,61 @@ uint8_t bt_setup() {
 
     uint8_t bt_test() {
         // Send the AT command (expecting OK or OK+LOST in response)
-        size_t responseLength = bt_sendATQuery("AT", "OK", responseBuffer, 6);
-        return responseLength == 0 || (responseLength > 0 && strcmp(responseBuffer, "+LOST") == 0);
+        // (the result is checked as well as the response, since no response also leaves an empty one)
+        if (!bt_atStart("AT", "OK", responseBuffer, 6, 0) || bt_atAwait() != BT_AT_OK)
+            return 0;
+        return atQueryLength == 0 || strcmp(responseBuffer, "+LOST") == 0;
     }
 
     size_t bt_getMACAddress(char* buffer, size_t bufferLength) {
         // Send the AT+ADDR? command (expecting OK+ADDR: to prefix the response)
-        return bt_sendATQuery("AT+ADDR?", "OK+ADDR:", buffer, bufferLength);
+        return bt_cachedQuery(BT_CONFIG_SETTING_MAC_ADDRESS, "AT+ADDR?", "OK+ADDR:", buffer, bufferLength);
+    }
+
+    uint8_t bt_getBaudRate(uint32_t* baudRate) {
+        // Send the AT+BAUD? command (expecting OK+Get: to prefix the response)
+        size_t responseLength = bt_sendATQuery("AT+BAUD?", "OK+Get:", responseBuffer, 2);
+
+        // If the command succeeded, look up the baud rate for the value returned
+        if (responseLength == 1 && responseBuffer[0] >= '0' && responseBuffer[0] < (char) ('0' + BT_AT_BAUD_RATE_COUNT)) {
+            *baudRate = atBaudRates[responseBuffer[0] - '0'];
+            return 1;
+        } else {
+            return 0;
+        }
     }
 
-    // TODO - AT+BAUD (?)
+    uint8_t bt_setBaudRate(uint32_t baudRate) {
+        // Find the value used for the baud rate by the AT+BAUD command
+        uint8_t value = 0;
+        while (value < BT_AT_BAUD_RATE_COUNT && atBaudRates[value] != baudRate)
+            value++;
+
+        // Check that the module supports the baud rate, and that the library can use it
+        // (otherwise we wouldn't be able to talk to the module after switching it)
+        if (value == BT_AT_BAUD_RATE_COUNT || !bt_uartBaudRateDivisor(baudRate))
+            return 0;
+
+        // Generate command and expected response
+        sprintf(commandBuffer, "AT+BAUD%d", value);
+        sprintf(responseBuffer, "OK+Set:%d", value);
+        if (!bt_sendATCommand(commandBuffer, responseBuffer))
+            return 0;
+
+        // The module only switches to the new baud rate once it restarts (it
+        // responds to the restart command at the old baud rate, so switch afterwards)
+        if (!bt_reset())
+            return 0;
+        return bt_setUARTBaudRate(baudRate);
+    }
 
     size_t bt_getModuleName(char* buffer, size_t bufferLength) {
         // Send the AT+NAME? command (expecting OK+NAME: to prefix the response)
-        return bt_sendATQuery("AT+NAME?", "OK+NAME:", buffer, bufferLength);
+        return bt_cachedQuery(BT_CONFIG_SETTING_NAME, "AT+NAME?", "OK+NAME:", buffer, bufferLength);
     }
 
-    uint8_t bt_setModuleName(const char* name) {
-        static char fixedLengthName[13];
+    // This function fixes a module name to the length required by the AT+NAME command
+    static void bt_fixModuleName(const char* name, char* fixedLengthName) {
         // Fix the name to the required length (12 + null-terminator)
         // All positions not occupied by the name will be filled
         // with the null character
@@ -96,21 +337,32 @@ uint8_t bt_setup() {
             strncpy(fixedLengthName, name, 12);
         }
         fixedLengthName[12] = '\0';
+    }
+
+    uint8_t bt_setModuleName(const char* name) {
+        static char fixedLengthName[13];
+        bt_fixModuleName(name, fixedLengthName);
+
+        // If the module already has this name, there's nothing to change
+        if (bt_cacheMatches(BT_CONFIG_SETTING_NAME, fixedLengthName))
+            return 1;
 
         // Generate command and expected response
         sprintf(commandBuffer, "AT+NAME%s", fixedLengthName);
         sprintf(responseBuffer, "OK+Set:%s", fixedLengthName);
 
-        return bt_sendATCommand(commandBuffer, responseBuffer);
+        uint8_t success = bt_sendATCommand(commandBuffer, responseBuffer);
+        bt_cacheUpdate(BT_CONFIG_SETTING_NAME, fixedLengthName, success);
+        return success;
     }
 
     size_t bt_getModulePIN(char* buffer, size_t bufferLength) {
         // Send the AT+PASS? command (expecting OK+Get: to prefix the response)
-        return bt_sendATQuery("AT+PASS?", "OK+Get:", buffer, bufferLength);
+        return bt_cachedQuery(BT_CONFIG_SETTING_PIN, "AT+PASS?", "OK+Get:", buffer, bufferLength);
     }
 
-    uint8_t bt_setModulePIN(const char* pin) {
-        static char fixedLengthPin[7];
+    // This function fixes a PIN to the length required by the AT+PASS command
+    static void bt_fixModulePIN(const char* pin, char* fixedLengthPin) {
         // Fix the PIN to the required length (6 + null-terminator)
         size_t pinLength = strlen(pin);
         if (pinLength == 6) {
@@ -126,27 +378,44 @@ uint8_t bt_setup() {
             }
         }
         fixedLengthPin[6] = '\0';
+    }
+
+    uint8_t bt_setModulePIN(const char* pin) {
+        static char fixedLengthPin[7];
+        bt_fixModulePIN(pin, fixedLengthPin);
+
+        // If the module already has this PIN, there's nothing to change
+        if (bt_cacheMatches(BT_CONFIG_SETTING_PIN, fixedLengthPin))
+            return 1;
 
         // Generate command and expected response
         sprintf(commandBuffer, "AT+PASS%s", fixedLengthPin);
         sprintf(responseBuffer, "OK+Set:%s", fixedLengthPin);
 
-        return bt_sendATCommand(commandBuffer, responseBuffer);
+        uint8_t success = bt_sendATCommand(commandBuffer, responseBuffer);
+        bt_cacheUpdate(BT_CONFIG_SETTING_PIN, fixedLengthPin, success);
+        return success;
     }
 
     uint8_t bt_resetFactoryDefaults() {
+        // The settings are about to change, so forget the cached ones
+        bt_invalidateConfiguration();
+
         // Send the AT+RENEW command (expecting OK+RENEW in response)
         return bt_sendATCommand("AT+RENEW", "OK+RENEW");
     }
 
     uint8_t bt_reset() {
+        // The settings may change when the module restarts, so forget the cached ones
+        bt_invalidateConfiguration();
+
         // Send the AT+RESET command (expecting OK+RESET in response)
         return bt_sendATCommand("AT+RESET", "OK+RESET");
     }
 
     uint8_t bt_getAuthenticationType(uint8_t* type) {
-        // Send the AT+PASS? command (expecting OK+Get: to prefix the response)
-        uint8_t success = bt_sendATQuery("AT+TYPE?", "OK+Get:", responseBuffer, 2);
+        // Send the AT+TYPE? command (expecting OK+Get: to prefix the response)
+        uint8_t success = bt_cachedQuery(BT_CONFIG_SETTING_AUTHENTICATION_TYPE, "AT+TYPE?", "OK+Get:", responseBuffer, 2);
 
         // If the command succeeded, parse it to the appropriate integer value
         if (success) {
@@ -179,11 +448,18 @@ uint8_t bt_setup() {
         if (type > 3)
             return 0;
 
+        // If the module already uses this type, there's nothing to change
+        char typeValue[2] = { '0' + type, '\0' };
+        if (bt_cacheMatches(BT_CONFIG_SETTING_AUTHENTICATION_TYPE, typeValue))
+            return 1;
+
         // Generate command and expected response
         sprintf(commandBuffer, "AT+TYPE%d", type);
         sprintf(responseBuffer, "OK+Set:%d", type);
 
-        return bt_sendATCommand(commandBuffer, responseBuffer);
+        uint8_t success = bt_sendATCommand(commandBuffer, responseBuffer);
+        bt_cacheUpdate(BT_CONFIG_SETTING_AUTHENTICATION_TYPE, typeValue, success);
+        return success;
     }
 
     /*
@@ -192,99 +468,250 @@ uint8_t bt_setup() {
     * -----------------------------------------------------------------------------
     */
 
+    // This function waits for the current command to complete
+    static uint8_t bt_atAwait() {
+        uint8_t result;
+        while ((result = bt_atPoll()) == BT_AT_PENDING)
+            bt_uartWait();
+        return result;
+    }
+
     uint8_t bt_sendATCommand(const char* command, const char* expectedResponse) {
-        // If the module is connected to a remote device, return 0
-        if (bt_connected())
+        // Start the command (if the module is connected to a remote device, return 0)
+        // and wait for it to complete
+        if (!bt_atStart(command, expectedResponse, NULL, 0, 0))
             return 0;
+        return bt_atAwait() == BT_AT_OK;
+    }
 
-        // Send command
-        while (*command) {
-            bt_write(*command++);
-        }
-
-        // Wait for a response to become available, or the timeout is exceeded
-        uartMillisecondCounter = 0;
-        while (!bt_available() && uartMillisecondCounter < BT_TIMEOUT_MS);
-        
-        // If we've received data, process it.  If not, return 0
-        if (bt_available()) {
-            // Check the characters in the UART stream against the expected response
-            char input;
-            while (bt_awaitAvailable() && *expectedResponse) {
-                input = (char) bt_read();
-                if (input != *expectedResponse)
-                    break;
-                expectedResponse++;
-            }
+    size_t bt_sendATQuery(const char* command, const char* expectedResponsePrefix, char* responseBuffer, size_t responseBufferLength) {
+        // Start the query (if the module is connected to a remote device, return 0)
+        // and wait for it to complete
+        if (!bt_atStart(command, expectedResponsePrefix, responseBuffer, responseBufferLength, 0))
+            return 0;
+        bt_atAwait();
+
+        // Return the length of the response (or -1 if the prefix wasn't present)
+        return atQueryLength;
+    }
+
+    /*
+    * -------------------------------------------------------------------------
+    * These functions send configuration commands without blocking the program:
+    * -------------------------------------------------------------------------
+    */
+
+    // This function completes the current command, and calls the callback (if there is one)
+    static void bt_atFinish(const uint8_t result) {
+        atState = BT_AT_STATE_DONE;
+        atResult = result;
+
+        if ((atFlags & BT_AT_FLAG_NOTIFY) && atCallback)
+            atCallback(result);
+    }
 
-            // Now that we've exhausted the expected response, make sure we don't have anything
-            // else left in the stream.  If we do, read/dispose of it and return 0
-            if (!bt_available() && !*expectedResponse) {
-                // Since the command completed successfully, wait for the defined time
-                // before returning for the change to take effect
-                uartMillisecondCounter = 0;
-                while (uartMillisecondCounter < BT_AT_SET_WAIT_TIME_MS);
-                // Now return after the wait period
-                return 1;
+    // This function checks the complete response to the current command against the expected response
+    static void bt_atCheckResponse() {
+        if (atQueryBuffer) {
+            // Check that the required prefix is present, and if not, fail (with a length of -1)
+            size_t prefixLength = strlen(atExpected);
+            if (strncmp(atResponse, atExpected, prefixLength) == 0) {
+                // Copy the remaining part of the response into the provided response buffer
+                size_t responseLength = strlen(atResponse) - prefixLength;
+                size_t responseBufferEnd = min(responseLength, atQueryBufferLength - 1);
+                strncpy(atQueryBuffer, atResponse + prefixLength, responseBufferEnd);
+                atQueryBuffer[responseBufferEnd] = '\0';
+                atQueryLength = responseBufferEnd;
+                bt_atFinish(BT_AT_OK);
             } else {
-                // Read the rest of the available bytes so the stream is ready
-                // to process the next command/input
-                while (bt_awaitAvailable())
-                    bt_read();
-                return 0;
+                atQueryLength = -1;
+                bt_atFinish(BT_AT_FAIL);
             }
         } else {
+            // The response must match exactly (with nothing left over).  If it does, wait for the
+            // defined time before completing for the change to take effect (unless the caller will)
+            if (!atResponseOverflow && strcmp(atResponse, atExpected) == 0) {
+                if (atFlags & BT_AT_FLAG_NO_SETTLE) {
+                    bt_atFinish(BT_AT_OK);
+                } else {
+                    atStepStart = bt_millis();
+                    atState = BT_AT_STATE_SETTLING;
+                }
+            } else {
+                bt_atFinish(BT_AT_FAIL);
+            }
+        }
+    }
+
+    uint8_t bt_atStart(const char* command, const char* expected, char* queryBuffer, size_t queryBufferLength, uint8_t flags) {
+        // Only one command can be carried out at a time, and commands can't be
+        // sent while the module is connected to a remote device
+        if (atResult == BT_AT_PENDING || bt_connected())
             return 0;
+
+        atCommand = command;
+        atExpected = expected;
+        atQueryBuffer = queryBuffer;
+        atQueryBufferLength = queryBufferLength;
+        atQueryLength = 0;
+        atFlags = flags;
+
+        atResult = BT_AT_PENDING;
+        atState = BT_AT_STATE_SENDING;
+        return 1;
+    }
+
+    uint8_t bt_atBegin(const char* command, const char* expectedResponse) {
+        return bt_atStart(command, expectedResponse, NULL, 0, BT_AT_FLAG_NOTIFY);
+    }
+
+    uint8_t bt_atBeginQuery(const char* command, const char* expectedResponsePrefix, char* responseBuffer, size_t responseBufferLength) {
+        return bt_atStart(command, expectedResponsePrefix, responseBuffer, responseBufferLength, BT_AT_FLAG_NOTIFY);
+    }
+
+    uint8_t bt_atPoll() {
+        switch (atState) {
+            case BT_AT_STATE_SENDING:
+                // Queue as much of the command as fits in the output buffer
+                while (*atCommand && bt_tryWrite(*atCommand))
+                    atCommand++;
+
+                // Wait for the whole command to be sent before timing the response
+                if (*atCommand || bt_txPending())
+                    break;
+                atStepStart = bt_millis();
+                atState = BT_AT_STATE_AWAITING;
+                // fall through
+
+            case BT_AT_STATE_AWAITING:
+                // Wait for a response to become available, or the timeout to be exceeded
+                if (!bt_available()) {
+                    if (bt_millis() - atStepStart >= BT_TIMEOUT_MS) {
+                        #if BT_ENABLE_STATISTICS
+                            bt_statsATTimeout();
+                        #endif
+                        if (atQueryBuffer)
+                            atQueryBuffer[0] = '\0';
+                        bt_atFinish(BT_AT_FAIL);
+                    }
+                    break;
+                }
+                atResponseLength = 0;
+                atResponseOverflow = 0;
+                atState = BT_AT_STATE_RECEIVING;
+                // fall through
+
+            case BT_AT_STATE_RECEIVING:
+                // Read the response into a buffer so we can check it later (if it overflows
+                // the buffer, the rest is read and disposed of so the UART stream can process
+                // future commands/input)
+                while (bt_available()) {
+                    uint8_t input = bt_read();
+                    if (atResponseLength < BT_AT_RESPONSE_BUFFER_LENGTH)
+                        atResponse[atResponseLength++] = (char) input;
+                    else
+                        atResponseOverflow = 1;
+                }
+
+                // The response is complete once the module stops sending data
+                if (!bt_uartReceiverIdle())
+                    break;
+                atResponse[atResponseLength] = '\0';
+                bt_atCheckResponse();
+                break;
+
+            case BT_AT_STATE_SETTLING:
+                // Wait for the change to take effect
+                if (bt_millis() - atStepStart >= BT_AT_SET_WAIT_TIME_MS)
+                    bt_atFinish(BT_AT_OK);
+                break;
         }
+
+        return atResult;
     }
 
-    size_t bt_sendATQuery(const char* command, const char* expectedResponsePrefix, char* responseBuffer, size_t responseBufferLength) {
-        // Keep one buffer for all queries (since it's reset before each read)
-        static char buffer[BT_AT_RESPONSE_BUFFER_LENGTH];
+    void bt_atSetCallback(bt_at_callback callback) {
+        atCallback = callback;
+    }
+
+    /*
+    * -----------------------------------------------------------------------------
+    * These functions change several settings with a single wait for them to apply:
+    * -----------------------------------------------------------------------------
+    */
 
-        // If the module is connected to a remote device, return -1
-        if (bt_connected())
+    void bt_configBegin() {
+        // Forget any settings that haven't been committed
+        configPendingSettings = 0;
+    }
+
+    void bt_configSetModuleName(const char* name) {
+        bt_fixModuleName(name, configModuleName);
+        configPendingSettings |= BT_CONFIG_SETTING_NAME;
+    }
+
+    void bt_configSetModulePIN(const char* pin) {
+        bt_fixModulePIN(pin, configModulePIN);
+        configPendingSettings |= BT_CONFIG_SETTING_PIN;
+    }
+
+    uint8_t bt_configSetAuthenticationType(uint8_t type) {
+        // Check that the type is within bounds
+        if (type > 3)
             return 0;
 
-        // Send command
-        while (*command) {
-            bt_write(*command++);
-        }
-
-        // Wait for a response to become available, or the timeout is exceeded
-        uartMillisecondCounter = 0;
-        while (!bt_available() && uartMillisecondCounter < BT_TIMEOUT_MS);
-        
-        // If we've received data, process it.  If not, return 0
-        if (bt_available()) {
-            // Read the data into a buffer so we can manipulate it later
-            size_t bufferIndex = 0;
-            while (bt_awaitAvailable() && bufferIndex < BT_AT_RESPONSE_BUFFER_LENGTH)
-                buffer[bufferIndex++] = (char) bt_read();
-            buffer[bufferIndex] = '\0';
+        configAuthenticationType = type;
+        configPendingSettings |= BT_CONFIG_SETTING_AUTHENTICATION_TYPE;
+        return 1;
+    }
 
-            // If we get enough data to overflow our buffer, read and dispose of the rest of the input
-            // so the UART stream can process future commands/input
-            if (bt_available())
-                while (bt_awaitAvailable())
-                    bt_read();
-            
-            size_t prefixLength = strlen(expectedResponsePrefix);
-            // Check that the required prefix is present, and if not, return -1
-            if (strncmp(buffer, expectedResponsePrefix, prefixLength) == 0) {
-                // Copy the remaining part of the response into the provided response buffer
-                size_t responseLength = strlen(buffer) - prefixLength;
-                size_t responseBufferEnd = min(responseLength, responseBufferLength - 1);
-                strncpy(responseBuffer, buffer + strlen(expectedResponsePrefix), responseBufferEnd);
-                responseBuffer[responseBufferEnd] = '\0';
-                return responseBufferEnd;
-            } else {
-                return -1;
-            }
-        } else {
-            responseBuffer[0] = '\0';
+    // This function sends the command in commandBuffer and checks the response against responseBuffer
+    // (without waiting for the change to take effect)
+    static uint8_t bt_configSend() {
+        if (!bt_atStart(commandBuffer, responseBuffer, NULL, 0, BT_AT_FLAG_NO_SETTLE))
             return 0;
+        return bt_atAwait() == BT_AT_OK;
+    }
+
+    uint8_t bt_configCommit() {
+        uint8_t success = 1;
+        uint8_t sent = 0;
+
+        // Send the collected settings back-to-back, checking each response but not
+        // waiting for each change to take effect (stop at the first failure)
+        // (settings that the module already has are skipped)
+        char typeValue[2] = { '0' + configAuthenticationType, '\0' };
+        if (success && (configPendingSettings & BT_CONFIG_SETTING_NAME) && !bt_cacheMatches(BT_CONFIG_SETTING_NAME, configModuleName)) {
+            sprintf(commandBuffer, "AT+NAME%s", configModuleName);
+            sprintf(responseBuffer, "OK+Set:%s", configModuleName);
+            success = bt_configSend();
+            bt_cacheUpdate(BT_CONFIG_SETTING_NAME, configModuleName, success);
+            sent |= success;
+        }
+        if (success && (configPendingSettings & BT_CONFIG_SETTING_PIN) && !bt_cacheMatches(BT_CONFIG_SETTING_PIN, configModulePIN)) {
+            sprintf(commandBuffer, "AT+PASS%s", configModulePIN);
+            sprintf(responseBuffer, "OK+Set:%s", configModulePIN);
+            success = bt_configSend();
+            bt_cacheUpdate(BT_CONFIG_SETTING_PIN, configModulePIN, success);
+            sent |= success;
+        }
+        if (success && (configPendingSettings & BT_CONFIG_SETTING_AUTHENTICATION_TYPE) && !bt_cacheMatches(BT_CONFIG_SETTING_AUTHENTICATION_TYPE, typeValue)) {
+            sprintf(commandBuffer, "AT+TYPE%d", configAuthenticationType);
+            sprintf(responseBuffer, "OK+Set:%d", configAuthenticationType);
+            success = bt_configSend();
+            bt_cacheUpdate(BT_CONFIG_SETTING_AUTHENTICATION_TYPE, typeValue, success);
+            sent |= success;
         }
+        configPendingSettings = 0;
+
+        // If anything was changed, wait once for all of the changes to take effect
+        if (sent) {
+            uint32_t waitStart = bt_millis();
+            while (bt_millis() - waitStart < BT_AT_SET_WAIT_TIME_MS)
+                bt_uartWait();
+        }
+
+        return success;
     }
 
 #endif
@@ -307,14 +734,41 @@ uint8_t bt_setup() {
  * -----------------------------------------------------------------------------------
  */
 
-// Input data will be stored to/read from this buffer
+// Input data will be stored to/read from this buffer (filled by the ISR, emptied by bt_read())
 volatile static uint8_t  uartInputBuffer[BT_UART_RX_BUFFER_LENGTH];
-// The index of the "write" head of the buffer
-volatile static uint8_t  uartBufferInputIndex;
-// The index of the "read" head of the buffer
-static uint8_t           uartBufferReadIndex;
+static bt_ring           uartInputRing = BT_RING_INITIALIZER(uartInputBuffer);
+// Output data will be queued in/sent from this buffer (filled by bt_write(), emptied by the ISR)
+volatile static uint8_t  uartOutputBuffer[BT_UART_TX_BUFFER_LENGTH];
+static bt_ring           uartOutputRing = BT_RING_INITIALIZER(uartOutputBuffer);
+// Regions of memory queued by bt_writev(), which are sent once the transmitter reaches uartTxJobStart in the output buffer
+volatile static bt_iovec      uartTxSegments[BT_UART_TX_MAX_SEGMENTS];
+// 1 if there are regions queued by bt_writev() that haven't been sent, 0 otherwise
+volatile static uint8_t       uartTxJobActive = 0;
+// The position in the output buffer that the regions were queued at (so they're sent in order with other bytes)
+volatile static bt_ring_index uartTxJobStart;
+// The number of regions queued, and the index of the region currently being sent
+volatile static uint8_t       uartTxJobSegmentCount;
+volatile static uint8_t       uartTxJobSegment;
+// The next byte to send from the current region, and the number of bytes left in it
+static const uint8_t* volatile uartTxJobData;
+volatile static size_t        uartTxJobRemaining;
 // 1 if we're receiving data, 0 otherwise
 volatile static uint8_t  uartReceiverBusy;
+// 1 if we're waiting for the stop bit for a packet
+volatile static uint8_t  uartAwaitingStopBit = 0;
+// Tracks the current bit position in the receiving buffer
+volatile static uint8_t  uartReceiverMask;
+// Counter to rectify the baud rate (since we're ticking at 3x baud rate)
+volatile static uint8_t  uartReceiverCounter;
+// Number of bits left to be received in the current packet
+volatile static uint8_t  uartRxBitsRemaining;
+// Buffer to store the byte currently being constructed
+volatile static uint8_t  uartRxBitBuffer;
+// Allow for the majority voting toggle
+#if BT_ENABLE_MAJORITY_VOTING
+    // The RX pin samples from the last few ticks (the newest sample is in the lowest bit)
+    volatile static uint8_t uartRxSamples;
+#endif
 // 1 if we're transmitting data, 0 otherwise
 volatile static uint8_t  uartTransmitterBusy;
 // Counter to rectify the baud rate (since we're ticking at 3x baud rate)
@@ -323,39 +777,460 @@ volatile static uint8_t  uartTransmitterCounter;
 volatile static uint8_t  uartTxBitsRemaining;
 // 10 bits long, so need 16-bit value instead of 8
 volatile static uint16_t uartTxBitBuffer;
-// Number of ticks since we last saw data (max of BT_UART_PACKET_WAIT_TICKS)
+// Number of milliseconds since we last saw data (max of BT_UART_PACKET_WAIT_MS)
 volatile static uint16_t uartPacketWaitTimer = 0;
-// Number of ticks since we last performed a state check (max of BT_UART_STATE_CHECK_TICKS)
+// Number of milliseconds since we last performed a state check (max of BT_UART_STATE_CHECK_MS)
 volatile static uint16_t uartStateCheckTimer = 0;
-// Number of ticks since we last incremented the millisecond counter (max of BT_UART_MILLISECOND_TICKS)
+// Number of ticks since we last incremented the millisecond counter (max of uartMillisecondTicks)
 volatile static uint16_t uartMillisecondCountTimer = 0;
+// The baud rate currently in use (changed by bt_setUARTBaudRate())
+volatile static uint32_t uartBaudRate = BT_BAUD_RATE;
+// The timer compare value for the current baud rate, and the number of ticks required for 1ms to pass
+// (these only change with the baud rate when the software UART is used)
+volatile static uint16_t uartTimerTop = BT_TIMER_TOP;
+volatile static uint16_t uartMillisecondTicks = BT_UART_MILLISECOND_TICKS;
 // Each bit represents the status of the Bluetooth state (smaller positions indicate newer times)
 volatile static uint16_t uartConnectionState = 0;
 // Track previous state of the connection (so we can fire handlers if the next state does not match)
 volatile static uint8_t  uartPrevConnected = 0;
 // Track current state of the connection (so we can fire handlers)
 volatile static uint8_t  uartConnected = 0;
+// Allow for the deferred event toggle
+#if BT_ENABLE_DEFERRED_EVENTS
+    // Connection changes will be queued in/processed from this buffer (filled by the ISR, emptied by bt_processEvents())
+    volatile static uint8_t uartEventBuffer[BT_EVENT_QUEUE_LENGTH];
+    static bt_ring          uartEventRing = BT_RING_INITIALIZER(uartEventBuffer);
+#endif
+// Allow for the software timer toggle
+#if BT_ENABLE_SOFTWARE_TIMERS
+    // The function called by each software timer, the number of milliseconds until it's next called,
+    // and the number of milliseconds between calls (0 if it's only called once)
+    volatile static bt_timer_callback timerCallbacks[BT_SOFTWARE_TIMER_COUNT];
+    volatile static uint16_t          timerRemaining[BT_SOFTWARE_TIMER_COUNT];
+    volatile static uint16_t          timerPeriods[BT_SOFTWARE_TIMER_COUNT];
+    // Each bit is 1 if the matching software timer is counting down
+    volatile static uint8_t           timerMask = 0;
+    // Allow for the deferred event toggle
+    #if BT_ENABLE_DEFERRED_EVENTS
+        // The number of calls each software timer has waiting for bt_processEvents()
+        volatile static uint8_t       timerDue[BT_SOFTWARE_TIMER_COUNT];
+    #endif
+#endif
+// Allow for the line mode toggle
+#if BT_ENABLE_LINE_MODE
+    // Number of delimiters stored in the input buffer (counted by the ISR), and the number removed from it
+    // (these count up freely like the ring buffer indexes, so the difference is the number of lines waiting)
+    volatile static bt_ring_index uartLinesReceived = 0;
+    static bt_ring_index          uartLinesRead = 0;
+#endif
+// Allow for the edge-triggered receiver toggle
+#if BT_ENABLE_EDGE_TRIGGERED_RX
+    // 1 if the timer is ticking at 3x the baud rate, 0 if it's ticking at the idle rate (1 tick per millisecond)
+    volatile static uint8_t uartTimerActive = 0;
+#endif
+// Allow for the low power idle toggle
+#if BT_ENABLE_LOW_POWER_IDLE
+    // 1 if the timer has been stopped because the link is idle
+    volatile static uint8_t uartTimerStopped = 0;
+    // Number of milliseconds the timer has to keep running for (see BT_UART_CLOCK_HOLD_MS)
+    volatile static uint8_t uartClockHold = 0;
+#endif
+// Allow for the statistics toggle
+#if BT_ENABLE_STATISTICS
+    // The counters reported by bt_getStats()
+    volatile static bt_stats uartStats;
+#endif
+// Allow for the ISR profiling toggle
+#if BT_ENABLE_ISR_PROFILING
+    // The path taken by the current pass through the timer ISR (see BT_ISR_PATH_*)
+    static uint8_t uartProfilePath = BT_ISR_PATH_IDLE;
+    // The timing measurements for each path (reported by bt_getISRProfile())
+    volatile static bt_isr_profile uartProfile;
+#endif
+
+// This function records that the timer ISR has taken a path (if it's a more expensive path than any taken so far this pass)
+static inline void bt_uartProfilePath(const uint8_t path) {
+    #if BT_ENABLE_ISR_PROFILING
+        if (path > uartProfilePath)
+            uartProfilePath = path;
+    #else
+        (void) path;
+    #endif
+}
+
+// This function records how long the current pass through the timer ISR has taken
+// (idle is 1 if the timer is ticking at the idle rate used by the edge-triggered receiver)
+static inline void bt_uartProfileRecord(const uint8_t idle) {
+    #if BT_ENABLE_ISR_PROFILING
+        // The timer counts up from 0 starting at the compare match that triggered this ISR,
+        // so it shows how long the ISR has been running (including the time taken to enter it)
+        uint16_t count = BT_TIMER_COUNTER_REGISTER;
+
+        // Find the prescaler and the number of cycles between ticks for the current timer rate
+        uint16_t prescale = BT_TIMER_PRESCALE_VALUE;
+        uint16_t budget = (uartTimerTop + 1) * BT_TIMER_PRESCALE_VALUE;
+        #if BT_ENABLE_EDGE_TRIGGERED_RX
+            if (idle) {
+                prescale = BT_TIMER_IDLE_PRESCALE_VALUE;
+                budget = BT_ISR_IDLE_BUDGET_CYCLES;
+            }
+        #else
+            (void) idle;
+        #endif
+        uint16_t cycles = count * prescale;
+
+        // If the compare flag is set again, the next tick arrived before this one finished and the
+        // counter restarted (this is checked after reading the counter, so a tick that ends right
+        // at the compare match is counted as an overrun rather than missed)
+        if (BT_TIMER_INTERRUPT_FLAG_REGISTER & BT_TIMER_INTERRUPT_FLAG_MASK) {
+            cycles += budget;
+            uartProfile.overruns++;
+        }
+
+        // Update the measurements for the path, and start over for the next pass
+        uint8_t path = uartProfilePath;
+        if (cycles > uartProfile.maxCycles[path])
+            uartProfile.maxCycles[path] = cycles;
+        uartProfile.counts[path]++;
+        uartProfilePath = BT_ISR_PATH_IDLE;
+    #else
+        (void) idle;
+    #endif
+}
+
+// This function finds the next byte to send (from the regions queued by bt_writev() or the output buffer)
+static inline uint8_t bt_uartNextTxByte(uint8_t* byte) {
+    // Once the transmitter has sent everything queued before the regions, send the regions
+    if (uartTxJobActive && uartOutputRing.tail == uartTxJobStart) {
+        *byte = *uartTxJobData++;
+
+        // If the current region is done, move to the next region that isn't empty
+        if (--uartTxJobRemaining == 0) {
+            uint8_t segment = uartTxJobSegment;
+            while (++segment < uartTxJobSegmentCount && uartTxSegments[segment].length == 0);
+            uartTxJobSegment = segment;
+
+            if (segment < uartTxJobSegmentCount) {
+                uartTxJobData = uartTxSegments[segment].data;
+                uartTxJobRemaining = uartTxSegments[segment].length;
+            } else {
+                // All regions have been handed off, so the caller can reuse them
+                uartTxJobActive = 0;
+            }
+        }
+    } else if (!bt_ringPop(&uartOutputRing, byte)) {
+        return 0;
+    }
+
+    #if BT_ENABLE_STATISTICS
+        uartStats.txBytes++;
+    #endif
+    return 1;
+}
+
+// This function starts receiving a byte whose start bit has just begun (the first data bit will be decided after the given number of ticks)
+static inline void bt_uartStartReceiver(const uint8_t ticks) {
+    uartReceiverBusy = 1;
+    uartRxBitBuffer = 0;
+    uartReceiverCounter = ticks;
+    uartRxBitsRemaining = BT_UART_RX_BITS;
+    uartReceiverMask = 1;
+    uartPacketWaitTimer = 0;
+}
+
+// This function determines the level of the bit being received (by a vote of the last three samples, if majority voting is enabled)
+static inline uint8_t bt_uartRxBit() {
+    #if BT_ENABLE_MAJORITY_VOTING
+        // The bit is high if at least two of the three samples are high
+        uint8_t samples = uartRxSamples;
+        return ((samples & (samples >> 1)) | (samples & (samples >> 2)) | ((samples >> 1) & (samples >> 2))) & 0x01;
+    #else
+        return bt_uartGetRx() != 0;
+    #endif
+}
+
+// This function stores a byte that has just been received (unless the receive handler takes it)
+static inline void bt_uartReceived(const uint8_t byte) {
+    #if BT_ENABLE_STATISTICS
+        uartStats.rxBytes++;
+    #endif
+
+    #if BT_ENABLE_RECEIVE_HANDLER
+        if (BT_RECEIVE_HANDLER(byte))
+            return;
+    #endif
+
+    // If the input buffer is full, the byte is dropped
+    if (!bt_ringPush(&uartInputRing, byte)) {
+        #if BT_ENABLE_STATISTICS
+            uartStats.rxOverruns++;
+        #endif
+        return;
+    }
+
+    // Count each delimiter stored, so bt_linesAvailable() knows how many complete lines are waiting
+    #if BT_ENABLE_LINE_MODE
+        if (byte == BT_LINE_DELIMITER)
+            uartLinesReceived++;
+    #endif
+
+    // Keep track of the most bytes that have been waiting in the input buffer
+    #if BT_ENABLE_STATISTICS
+        bt_ring_index count = bt_ringCount(&uartInputRing);
+        if (count > uartStats.rxHighWater)
+            uartStats.rxHighWater = count;
+    #endif
+}
+
+// This function runs the handler for a connection change (if it's enabled)
+static inline void bt_uartRunHandler(const uint8_t event) {
+    #if BT_ENABLE_CONNECTION_HANDLER
+        if (event == BT_EVENT_CONNECTION)
+            BT_CONNECTION_HANDLER();
+    #endif
+    #if BT_ENABLE_DISCONNECTION_HANDLER
+        if (event == BT_EVENT_DISCONNECTION)
+            BT_DISCONNECTION_HANDLER();
+    #endif
+    #if !BT_ENABLE_CONNECTION_HANDLER && !BT_ENABLE_DISCONNECTION_HANDLER
+        // Neither handler is enabled, so there's nothing to run
+        (void) event;
+    #endif
+}
+
+// This function handles a connection change seen by the timer ISR
+// (the handler is run right away, or queued for bt_processEvents() if events are deferred)
+static inline void bt_uartConnectionChanged(const uint8_t event) {
+    #if BT_ENABLE_DEFERRED_EVENTS
+        // If the queue is full, the event is dropped
+        bt_ringPush(&uartEventRing, event);
+    #else
+        bt_uartRunHandler(event);
+    #endif
+}
+
+// This function runs from the timer ISR each time a millisecond has elapsed
+static inline void bt_uartMillisecondElapsed() {
+    bt_uartProfilePath(BT_ISR_PATH_MILLISECOND);
+
+    // Increment the millisecond counter
+    uartMillisecondCounter++;
+
+    // Count down the time the timer has to keep running for
+    #if BT_ENABLE_LOW_POWER_IDLE
+        if (uartClockHold)
+            uartClockHold--;
+    #endif
+
+    // Count down the software timers, and call (or queue) the ones that are due
+    #if BT_ENABLE_SOFTWARE_TIMERS
+        if (timerMask) {
+            for (uint8_t timer = 0; timer < BT_SOFTWARE_TIMER_COUNT; timer++) {
+                if ((timerMask & (1 << timer)) && --timerRemaining[timer] == 0) {
+                    // Periodic timers start counting down again, and the others stop
+                    if (timerPeriods[timer])
+                        timerRemaining[timer] = timerPeriods[timer];
+                    else
+                        timerMask &= ~(1 << timer);
+
+                    #if BT_ENABLE_DEFERRED_EVENTS
+                        if (timerDue[timer] < UINT8_MAX)
+                            timerDue[timer]++;
+                    #else
+                        timerCallbacks[timer]();
+                    #endif
+                }
+            }
+        }
+    #endif
+
+    // If we're not receiving a byte, increment the packet wait timer
+    // so we can determine if any more data is being sent
+    if (!uartReceiverBusy && uartPacketWaitTimer < BT_UART_PACKET_WAIT_MS)
+        uartPacketWaitTimer++;
+
+    // Check the status of the Bluetooth state if we've reached the threshold of the timer
+    if (++uartStateCheckTimer >= BT_UART_STATE_CHECK_MS) {
+        bt_uartProfilePath(BT_ISR_PATH_STATE_CHECK);
+
+        // Reset timer
+        uartStateCheckTimer = 0;
+
+        // Check the state of the module
+        uartConnectionState = (uartConnectionState << 1) | (bt_uartGetState() != 0);
+
+        // Check for changes in connection state (and if handlers are enabled, run them)
+        uartPrevConnected = uartConnected;
+        uartConnected = (uartConnectionState & 0x0F) == 0x0F;
+        #if BT_ENABLE_CONNECTION_HANDLER
+            if (!uartPrevConnected && uartConnected)
+                bt_uartConnectionChanged(BT_EVENT_CONNECTION);
+        #endif
+        #if BT_ENABLE_DISCONNECTION_HANDLER
+            if (uartPrevConnected && !uartConnected)
+                bt_uartConnectionChanged(BT_EVENT_DISCONNECTION);
+        #endif
+        #if BT_ENABLE_STATISTICS
+            if (!uartPrevConnected && uartConnected)
+                uartStats.connections++;
+            if (uartPrevConnected && !uartConnected)
+                uartStats.disconnections++;
+        #endif
+
+        // Decrement the initial connection check counter if it's not at 0
+        if (uartInitialConnectionCheckCountdown)
+            uartInitialConnectionCheckCountdown--;
+    }
+}
+
+// Allow for the edge-triggered receiver toggle
+#if BT_ENABLE_EDGE_TRIGGERED_RX
+
+    // This function switches the timer from the idle rate to 3x the baud rate
+    // (it must be called with interrupts disabled)
+    static inline void bt_uartActivateTimer(const uint8_t counterValue) {
+        // Save how far we are through the current millisecond so the millisecond counter doesn't drift
+        uint8_t idleCount = BT_TIMER_COUNTER_REGISTER;
+
+        // Switch to the bit rate timer settings
+        BT_TIMER_CONTROL_REGISTER_A = BT_TIMER_CONTROL_REGISTER_A_MASK | BT_TIMER_PRESCALER_REG_A_MASK;
+        BT_TIMER_CONTROL_REGISTER_B = BT_TIMER_CONTROL_REGISTER_B_MASK | BT_TIMER_PRESCALER_REG_B_MASK;
+        BT_TIMER_COMPARE_REGISTER = uartTimerTop;
+        BT_TIMER_COUNTER_REGISTER = counterValue;
+        uartTimerActive = 1;
+        #if BT_ENABLE_LOW_POWER_IDLE
+            uartTimerStopped = 0;
+        #endif
+
+        // Convert the progress through the current millisecond into bit rate ticks
+        uartMillisecondCountTimer = ((uint32_t) idleCount * uartMillisecondTicks) / (BT_TIMER_IDLE_TOP + 1);
+    }
+
+    // This function switches the timer from 3x the baud rate to the idle rate
+    // (it must be called with interrupts disabled)
+    static inline void bt_uartIdleTimer() {
+        // Switch to the idle timer settings, converting the progress through
+        // the current millisecond into idle ticks so the millisecond counter doesn't drift
+        BT_TIMER_CONTROL_REGISTER_A = BT_TIMER_CONTROL_REGISTER_A_MASK | BT_TIMER_IDLE_PRESCALER_REG_A_MASK;
+        BT_TIMER_CONTROL_REGISTER_B = BT_TIMER_CONTROL_REGISTER_B_MASK | BT_TIMER_IDLE_PRESCALER_REG_B_MASK;
+        BT_TIMER_COMPARE_REGISTER = BT_TIMER_IDLE_TOP;
+        BT_TIMER_COUNTER_REGISTER = ((uint32_t) uartMillisecondCountTimer * (BT_TIMER_IDLE_TOP + 1)) / uartMillisecondTicks;
+        uartTimerActive = 0;
+    }
+
+    // Allow for the low power idle toggle
+    #if BT_ENABLE_LOW_POWER_IDLE
+
+        // This function determines if the idling timer can be stopped (nothing is being received, nothing is waiting
+        // for a timeout, and the connection state can only change once the State pin changes)
+        static inline uint8_t bt_uartLinkIdle() {
+            #if BT_ENABLE_SOFTWARE_TIMERS
+                // The software timers are counted down by the timer
+                if (timerMask)
+                    return 0;
+            #endif
+            uint8_t state = bt_uartGetState() != 0;
+            return bt_uartReceiverIdle() && !uartClockHold && !uartInitialConnectionCheckCountdown
+                && state == uartConnected && (uartConnectionState & 0x01) == state;
+        }
+
+        // This function stops the timer (it must be called with interrupts disabled)
+        static inline void bt_uartStopTimer() {
+            BT_TIMER_CONTROL_REGISTER_B = BT_TIMER_CONTROL_REGISTER_B_MASK;
+            uartTimerStopped = 1;
+        }
+
+        // This function starts the timer again at the idle rate if it was stopped
+        // (it must be called with interrupts disabled)
+        static inline void bt_uartWakeTimer() {
+            if (uartTimerStopped) {
+                BT_TIMER_COUNTER_REGISTER = 0;
+                BT_TIMER_CONTROL_REGISTER_B = BT_TIMER_CONTROL_REGISTER_B_MASK | BT_TIMER_IDLE_PRESCALER_REG_B_MASK;
+                uartTimerStopped = 0;
+            }
+        }
+
+        // This ISR runs each time the State pin changes
+        ISR(BT_STATE_INTERRUPT_VECTOR) {
+            // Start the timer again so the new state gets checked
+            bt_uartWakeTimer();
+        }
+
+    #endif
+
+    // This function starts listening for the next start bit on the RX pin
+    static inline void bt_uartListenForStartBit() {
+        // Clear any edges seen while the last byte was received, then enable the interrupt
+        BT_RX_INTERRUPT_FLAG_REGISTER = BT_RX_INTERRUPT_FLAG_MASK;
+        BT_RX_INTERRUPT_MASK_REGISTER |= BT_RX_INTERRUPT_ENABLE_MASK;
+    }
+
+    // This ISR runs on the falling edge of a start bit on the RX pin
+    ISR(BT_RX_INTERRUPT_VECTOR) {
+        // Ignore rising edges (in case a pin change interrupt is used)
+        if (bt_uartGetRx())
+            return;
+
+        // Stop listening for edges until the byte has been received
+        BT_RX_INTERRUPT_MASK_REGISTER &= ~BT_RX_INTERRUPT_ENABLE_MASK;
+
+        // Line up the timer ticks so that every third tick falls in the middle of a bit.
+        // If the transmitter is using the timer, it can't be moved, so just use the next
+        // tick (which is at most half a tick away from the middle)
+        if (!uartTimerActive)
+            bt_uartActivateTimer(uartTimerTop / 2);
+        else if (!uartTransmitterBusy)
+            BT_TIMER_COUNTER_REGISTER = uartTimerTop / 2;
+
+        // Initialize the receiver values (the first data bit is 1.5 bits, or 4.5 ticks, away)
+        bt_uartStartReceiver(5 + BT_UART_RX_VOTE_DELAY);
+    }
+
+#endif
 
 // This ISR runs reach time the timer overflows, which happens at 3x the specified baud rate
+// (or at BT_TIMER_HARDWARE_UART_TICK_RATE when the hardware USART is used, and once every
+// millisecond while the edge-triggered receiver is idle)
 ISR(BT_TIMER_INTERRUPT_VECTOR) {
-    // 1 if we're waiting for the stop bit for a packet
-    static uint8_t uartAwaitingStopBit = 0;
-    // Tracks the current bit position in the receiving buffer
-    static uint8_t uartReceiverMask;
-    // Counter to rectify the baud rate (since we're ticking at 3x baud rate)
-    static uint8_t uartReceiverCounter;
-    // Number of bits left to be received in the current packet
-    static uint8_t uartRxBitsRemaining;
-    // Buffer to store the byte currently being constructed
-    static uint8_t uartRxBitBuffer;
+    #if BT_ENABLE_EDGE_TRIGGERED_RX
+        // If the timer is idling, each tick is a full millisecond
+        if (!uartTimerActive) {
+            bt_uartMillisecondElapsed();
+
+            // If the link is idle, stop the timer until it's needed again
+            #if BT_ENABLE_LOW_POWER_IDLE
+                if (bt_uartLinkIdle())
+                    bt_uartStopTimer();
+            #endif
+
+            bt_uartProfileRecord(1);
+            return;
+        }
+    #endif
 
+#if !BT_ENABLE_HARDWARE_UART
     // Temporary variable to store counters for operations
     uint8_t counter;
+    // Temporary variable to store the next byte to send
+    uint8_t byte;
+
+    // If the transmitter is ready and there are bytes queued, load the next one
+    if (!uartTransmitterBusy && bt_uartNextTxByte(&byte)) {
+        // Transform the byte into a UART packet
+        uartTxBitBuffer = (byte << 1) | 0x200;
+
+        // Set up transmitter to transmit the byte
+        uartTransmitterCounter = 3;
+        uartTxBitsRemaining = BT_UART_TX_BITS;
+        uartTransmitterBusy = 1;
+    }
 
     // Send data from the output buffer (if there is data to send)
     if (uartTransmitterBusy) {
         counter = uartTransmitterCounter;
         if (--counter == 0) {
+            bt_uartProfilePath(BT_ISR_PATH_TX_BIT);
+
             // Send next bit in output buffer
             if (uartTxBitBuffer & 0x01)
                 bt_uartSetTxHigh();
@@ -373,47 +1248,78 @@ ISR(BT_TIMER_INTERRUPT_VECTOR) {
         uartTransmitterCounter = counter;
     }
 
+    #if BT_ENABLE_MAJORITY_VOTING
+        // While receiving, sample the RX pin on every tick (so each bit can be decided by the three samples around its middle)
+        if (uartReceiverBusy)
+            uartRxSamples = (uartRxSamples << 1) | (bt_uartGetRx() != 0);
+    #endif
+
     // Read data off of the UART receiver pin into the input buffer
     if (uartAwaitingStopBit) {
         if (--uartReceiverCounter == 0) {
+            bt_uartProfilePath(BT_ISR_PATH_STOP_BIT);
+
+            // Check that the stop bit is high (if it isn't, the byte wasn't framed correctly)
+            #if BT_ENABLE_MAJORITY_VOTING || BT_ENABLE_STATISTICS
+                uint8_t framed = bt_uartRxBit();
+                #if BT_ENABLE_STATISTICS
+                    if (!framed)
+                        uartStats.framingErrors++;
+                #endif
+            #endif
+
             // Tell receiver we're ready for the next byte
             uartAwaitingStopBit = 0;
             uartReceiverBusy = 0;
-            // Insert received bit into input buffer
-            uartInputBuffer[uartBufferInputIndex] = uartRxBitBuffer;
-            // Increment buffer index (or wrap if at end)
-            if (++uartBufferInputIndex >= BT_UART_RX_BUFFER_LENGTH)
-                uartBufferInputIndex = 0;
-            
+            // Insert received byte into input buffer (if the buffer is full, the byte is dropped)
+            // When voting, bytes that weren't framed correctly are dropped too
+            #if BT_ENABLE_MAJORITY_VOTING
+                if (framed)
+                    bt_uartReceived(uartRxBitBuffer);
+            #else
+                bt_uartReceived(uartRxBitBuffer);
+            #endif
+
             // Reset the UART packet wait timer
             uartPacketWaitTimer = 0;
+
+            #if BT_ENABLE_MAJORITY_VOTING
+                // The last sample was taken after the middle of the stop bit, so if it's low, the next start bit has
+                // already begun (and the receiver would otherwise miss its edge, or detect it a tick late)
+                if (!(uartRxSamples & 0x01))
+                    bt_uartStartReceiver(4 + BT_UART_RX_VOTE_DELAY);
+                #if BT_ENABLE_EDGE_TRIGGERED_RX
+                    else
+                        bt_uartListenForStartBit();
+                #endif
+            #elif BT_ENABLE_EDGE_TRIGGERED_RX
+                // Start listening for the next start bit
+                bt_uartListenForStartBit();
+            #endif
         }
     } else {
         // If we're not currently reading a byte, wait
         // for the next start bit
         if (uartReceiverBusy == 0) {
             // If we receive the start bit, initialize the receiver values
-            if (bt_uartGetRx() == 0) {
-                uartReceiverBusy = 1;
-                uartRxBitBuffer = 0;
-                uartReceiverCounter = 4;
-                uartRxBitsRemaining = BT_UART_RX_BITS;
-                uartReceiverMask = 1;
-                uartPacketWaitTimer = 0;
-            } else {
-                // Since we didn't receive the start bit, increment the packet wait timer
-                // so we can determine if any more data is being sent
-                if (uartPacketWaitTimer < BT_UART_PACKET_WAIT_TICKS)
-                    uartPacketWaitTimer++;
-            }
+            // (the edge-triggered receiver does this from its own ISR instead)
+            #if !BT_ENABLE_EDGE_TRIGGERED_RX
+                if (bt_uartGetRx() == 0) {
+                    bt_uartProfilePath(BT_ISR_PATH_RX_BIT);
+
+                    bt_uartStartReceiver(4 + BT_UART_RX_VOTE_DELAY);
+                }
+            #endif
         } else {
             counter = uartReceiverCounter;
             if (--counter == 0) {
+                bt_uartProfilePath(BT_ISR_PATH_RX_BIT);
+
                 // Reset counter
                 counter = 3;
 
                 // Receive the next bit and insert it into the buffer
-                if (bt_uartGetRx())
+                if (bt_uartRxBit())
                     uartRxBitBuffer |= uartReceiverMask;
                 // Shift the receiver mask for the next bit
                 uartReceiverMask <<= 1;
@@ -422,44 +1328,78 @@ ISR(BT_TIMER_INTERRUPT_VECTOR) {
                 if (--uartRxBitsRemaining == 0)
                     uartAwaitingStopBit = 1;
             }
+            #if BT_ENABLE_MAJORITY_VOTING
+                // The counter is only 4 in the middle of the start bit, so if the line is high
+                // there, the start bit was just noise (stop receiving and wait for the next one)
+                else if (counter == 4 && (uartRxSamples & 0x01)) {
+                    uartReceiverBusy = 0;
+                    #if BT_ENABLE_EDGE_TRIGGERED_RX
+                        bt_uartListenForStartBit();
+                    #endif
+                }
+            #endif
             uartReceiverCounter = counter;
         }
     }
+#endif
 
-    // Increment the millisecond counter if 1ms has elapsed
-    if (uartMillisecondCountTimer++ == BT_UART_MILLISECOND_TICKS) {
+    // Run the millisecond tasks if 1ms has elapsed
+    if (++uartMillisecondCountTimer >= uartMillisecondTicks) {
         // Reset timer
         uartMillisecondCountTimer = 0;
 
-        // Increment the millisecond counter
-        uartMillisecondCounter++;
+        bt_uartMillisecondElapsed();
     }
 
-    // Check the status of the Bluetooth state if we've reached the threshold of the timer
-    if (uartStateCheckTimer++ == BT_UART_STATE_CHECK_TICKS) {
-        // Reset timer
-        uartStateCheckTimer = 0;
+    // Record the timing of this pass (before the timer is switched to the idle rate)
+    bt_uartProfileRecord(0);
 
-        // Check the state of the module
-        uartConnectionState = (uartConnectionState << 1) | (bt_uartGetState() != 0);
+    #if BT_ENABLE_EDGE_TRIGGERED_RX
+        // If there's nothing left to send or receive, slow the timer back down
+        if (!uartTransmitterBusy && !uartReceiverBusy && !uartTxJobActive && bt_ringEmpty(&uartOutputRing))
+            bt_uartIdleTimer();
+    #endif
+}
 
-        // Check for changes in connection state (and if handlers are enabled, run them)
-        uartPrevConnected = uartConnected;
-        uartConnected = (uartConnectionState & 0x0F) == 0x0F;
-        #if BT_ENABLE_CONNECTION_HANDLER
-            if (!uartPrevConnected && uartConnected)
-                BT_CONNECTION_HANDLER();
-        #endif
-        #if BT_ENABLE_DISCONNECTION_HANDLER
-            if (uartPrevConnected && !uartConnected)
-                BT_DISCONNECTION_HANDLER();
+// Allow for the hardware USART toggle
+#if BT_ENABLE_HARDWARE_UART
+
+    // This ISR runs each time the USART finishes receiving a byte
+    ISR(BT_USART_RX_INTERRUPT_VECTOR) {
+        // Check the USART's error flags (they must be read before the data register)
+        #if BT_ENABLE_STATISTICS
+            uint8_t status = BT_USART_CONTROL_REGISTER_A;
+            if (status & BT_USART_FRAME_ERROR_MASK)
+                uartStats.framingErrors++;
+            if (status & BT_USART_DATA_OVERRUN_MASK)
+                uartStats.rxOverruns++;
         #endif
 
-        // Decrement the initial connection check counter if it's not at 0
-        if (uartInitialConnectionCheckCountdown)
-            uartInitialConnectionCheckCountdown--;
+        // Insert received byte into input buffer (reading the data register clears the interrupt)
+        // If the buffer is full, the byte is dropped
+        bt_uartReceived(BT_USART_DATA_REGISTER);
+
+        // Reset the UART packet wait timer
+        uartPacketWaitTimer = 0;
     }
-}
+
+    // This ISR runs each time the USART data register is ready for another byte
+    ISR(BT_USART_UDRE_INTERRUPT_VECTOR) {
+        uint8_t byte;
+        if (bt_uartNextTxByte(&byte)) {
+            // Clear the transmit complete flag so bt_txPending() can tell when this byte is done
+            BT_USART_CONTROL_REGISTER_A |= BT_USART_TX_COMPLETE_MASK;
+            uartTransmitterBusy = 1;
+
+            // Hand the next byte to the USART
+            BT_USART_DATA_REGISTER = byte;
+        } else {
+            // Nothing is left to send, so disable this interrupt until bt_tryWrite() queues more data
+            BT_USART_CONTROL_REGISTER_B &= ~BT_USART_UDRE_INTERRUPT_MASK;
+        }
+    }
+
+#endif
 
 /*
  * ---------------------------------------------------------------------
@@ -469,8 +1409,11 @@ ISR(BT_TIMER_INTERRUPT_VECTOR) {
 
 void bt_initializeUARTPins() {
     // Set TX pin to output, and RX and State pins to input
-    BT_TX_DDR |= (1 << BT_TX_BIT);
-    BT_RX_DDR &= ~(1 << BT_RX_BIT);
+    // (the USART takes over its own pins, so only the State pin is needed for it)
+    #if !BT_ENABLE_HARDWARE_UART
+        BT_TX_DDR |= (1 << BT_TX_BIT);
+        BT_RX_DDR &= ~(1 << BT_RX_BIT);
+    #endif
     BT_STATE_DDR &= ~(1 << BT_STATE_BIT);
 }
 
@@ -480,10 +1423,17 @@ void bt_initializeUARTTimer() {
     // Disable interrupts while the timer is initialized
     cli();
 
-    // Setup the UART interrupt timer
-    BT_TIMER_COMPARE_REGISTER = BT_TIMER_TOP;
-    BT_TIMER_CONTROL_REGISTER_A = BT_TIMER_CONTROL_REGISTER_A_MASK | BT_TIMER_PRESCALER_REG_A_MASK;
-    BT_TIMER_CONTROL_REGISTER_B = BT_TIMER_CONTROL_REGISTER_B_MASK | BT_TIMER_PRESCALER_REG_B_MASK;
+    // Setup the UART interrupt timer (the edge-triggered receiver starts out idling)
+    #if BT_ENABLE_EDGE_TRIGGERED_RX
+        BT_TIMER_COMPARE_REGISTER = BT_TIMER_IDLE_TOP;
+        BT_TIMER_CONTROL_REGISTER_A = BT_TIMER_CONTROL_REGISTER_A_MASK | BT_TIMER_IDLE_PRESCALER_REG_A_MASK;
+        BT_TIMER_CONTROL_REGISTER_B = BT_TIMER_CONTROL_REGISTER_B_MASK | BT_TIMER_IDLE_PRESCALER_REG_B_MASK;
+        uartTimerActive = 0;
+    #else
+        BT_TIMER_COMPARE_REGISTER = uartTimerTop;
+        BT_TIMER_CONTROL_REGISTER_A = BT_TIMER_CONTROL_REGISTER_A_MASK | BT_TIMER_PRESCALER_REG_A_MASK;
+        BT_TIMER_CONTROL_REGISTER_B = BT_TIMER_CONTROL_REGISTER_B_MASK | BT_TIMER_PRESCALER_REG_B_MASK;
+    #endif
     BT_TIMER_INTERRUPT_MASK_REGISTER |= BT_TIMER_INTERRUPT_ENABLE_MASK;
     // Set counter to 0
     BT_TIMER_COUNTER_REGISTER = 0;
@@ -492,17 +1442,88 @@ void bt_initializeUARTTimer() {
     SREG = sregTemp;
 }
 
+// Allow for the edge-triggered receiver toggle
+#if BT_ENABLE_EDGE_TRIGGERED_RX
+
+    void bt_initializeUARTEdgeInterrupt() {
+        // Save the status register so we can restore it later
+        uint8_t sregTemp = SREG;
+        // Disable interrupts while the external interrupt is initialized
+        cli();
+
+        // Trigger on falling edges of the RX pin, and start listening for a start bit
+        BT_RX_INTERRUPT_CONTROL_REGISTER |= BT_RX_INTERRUPT_CONTROL_MASK;
+        bt_uartListenForStartBit();
+
+        // Restore the status register
+        SREG = sregTemp;
+    }
+
+#endif
+
+// Allow for the low power idle toggle
+#if BT_ENABLE_LOW_POWER_IDLE
+
+    void bt_initializeUARTStateInterrupt() {
+        // Save the status register so we can restore it later
+        uint8_t sregTemp = SREG;
+        // Disable interrupts while the pin change interrupt is initialized
+        cli();
+
+        // Trigger on any change of the State pin
+        BT_STATE_INTERRUPT_MASK_REGISTER |= BT_STATE_INTERRUPT_ENABLE_MASK;
+        BT_STATE_INTERRUPT_CONTROL_REGISTER |= BT_STATE_INTERRUPT_CONTROL_MASK;
+
+        // Restore the status register
+        SREG = sregTemp;
+    }
+
+#endif
+
+// Allow for the hardware USART toggle
+#if BT_ENABLE_HARDWARE_UART
+
+    void bt_initializeUSART() {
+        // Save the status register so we can restore it later
+        uint8_t sregTemp = SREG;
+        // Disable interrupts while the USART is initialized
+        cli();
+
+        // Set the baud rate (using double-speed mode for better accuracy)
+        BT_USART_BAUD_REGISTER_HIGH = (uint8_t) (BT_USART_BAUD_VALUE >> 8);
+        BT_USART_BAUD_REGISTER_LOW = (uint8_t) BT_USART_BAUD_VALUE;
+        BT_USART_CONTROL_REGISTER_A = BT_USART_DOUBLE_SPEED_MASK;
+        // Use 8 data bits, no parity, and 1 stop bit, and enable the receiver/transmitter
+        BT_USART_CONTROL_REGISTER_C = BT_USART_FRAME_FORMAT_MASK;
+        BT_USART_CONTROL_REGISTER_B = BT_USART_ENABLE_MASK;
+
+        // Restore the status register
+        SREG = sregTemp;
+    }
+
+#endif
+
 void bt_initializeUART() {
     // Set busy flags to false initially
     uartTransmitterBusy = 0;
     uartReceiverBusy = 0;
 
-    // Turn on TX pin
-    bt_uartSetTxHigh();
+    // Turn on TX pin (or set up the USART)
+    #if BT_ENABLE_HARDWARE_UART
+        bt_initializeUSART();
+    #else
+        bt_uartSetTxHigh();
+    #endif
 
     // Initialize pins/timer used for UART
     bt_initializeUARTPins();
     bt_initializeUARTTimer();
+    #if BT_ENABLE_EDGE_TRIGGERED_RX
+        bt_initializeUARTEdgeInterrupt();
+    #endif
+    #if BT_ENABLE_LOW_POWER_IDLE
+        bt_initializeUARTStateInterrupt();
+    #endif
 }
 
 /*
@@ -516,9 +1537,220 @@ uint8_t bt_connected() {
     return uartConnected;
 }
 
+// Allow for the deferred event toggle
+#if BT_ENABLE_DEFERRED_EVENTS
+
+    uint8_t bt_processEvents() {
+        // Run the handler for each queued event, oldest first
+        uint8_t processed = 0;
+        uint8_t event;
+        while (bt_ringPop(&uartEventRing, &event)) {
+            bt_uartRunHandler(event);
+            processed++;
+        }
+
+        // Call the software timers that are due
+        #if BT_ENABLE_SOFTWARE_TIMERS
+            for (uint8_t timer = 0; timer < BT_SOFTWARE_TIMER_COUNT; timer++) {
+                if (!timerDue[timer])
+                    continue;
+
+                // Save the status register and disable interrupts so the ISR can't add a call while they're being taken
+                uint8_t sregTemp = SREG;
+                cli();
+                uint8_t due = timerDue[timer];
+                timerDue[timer] = 0;
+                bt_timer_callback callback = timerCallbacks[timer];
+                SREG = sregTemp;
+
+                while (due--) {
+                    callback();
+                    processed++;
+                }
+            }
+        #endif
+
+        return processed;
+    }
+
+#endif
+
+// Allow for the software timer toggle
+#if BT_ENABLE_SOFTWARE_TIMERS
+
+    uint8_t bt_startTimer(bt_timer_callback callback, const uint16_t delayMs, const uint16_t periodMs) {
+        // Save the status register and disable interrupts so the ISR doesn't see a timer that's partway through being set up
+        uint8_t sregTemp = SREG;
+        cli();
+
+        // Find a timer that isn't counting down (or waiting for bt_processEvents() to call it)
+        uint8_t timer;
+        for (timer = 0; timer < BT_SOFTWARE_TIMER_COUNT; timer++) {
+            #if BT_ENABLE_DEFERRED_EVENTS
+                if (timerDue[timer])
+                    continue;
+            #endif
+            if (!(timerMask & (1 << timer)))
+                break;
+        }
+
+        if (timer < BT_SOFTWARE_TIMER_COUNT) {
+            timerCallbacks[timer] = callback;
+            timerRemaining[timer] = delayMs ? delayMs : 1;
+            timerPeriods[timer] = periodMs;
+            timerMask |= (1 << timer);
+
+            // The timer needs the millisecond tick, so make sure it's running
+            #if BT_ENABLE_LOW_POWER_IDLE
+                bt_uartWakeTimer();
+            #endif
+        } else {
+            timer = BT_TIMER_NONE;
+        }
+
+        // Restore the status register
+        SREG = sregTemp;
+        return timer;
+    }
+
+    void bt_cancelTimer(const uint8_t timer) {
+        if (timer >= BT_SOFTWARE_TIMER_COUNT)
+            return;
+
+        // Save the status register and disable interrupts so the ISR can't call the timer partway through
+        uint8_t sregTemp = SREG;
+        cli();
+        timerMask &= ~(1 << timer);
+        #if BT_ENABLE_DEFERRED_EVENTS
+            timerDue[timer] = 0;
+        #endif
+        SREG = sregTemp;
+    }
+
+#endif
+
+uint32_t bt_uartBaudRateDivisor(const uint32_t baudRate) {
+    if (baudRate == 0)
+        return 0;
+
+    #if BT_ENABLE_HARDWARE_UART
+        // Find the USART baud rate register value (using double-speed mode, rounded to the nearest value)
+        uint32_t divisor = ((F_CPU / 8) + (baudRate / 2)) / baudRate;
+        if (divisor == 0 || divisor > 4096)
+            return 0;
+        uint32_t actualBaudRate = (F_CPU / 8) / divisor;
+    #else
+        // Find the timer compare value for 3x the baud rate (rounded to the nearest value)
+        uint32_t tickRate = baudRate * 3;
+        uint32_t divisor = ((F_CPU / BT_TIMER_PRESCALE_VALUE) + (tickRate / 2)) / tickRate;
+        if (divisor < 2 || divisor - 1 > BT_TIMER_MAXIMUM_VALUE)
+            return 0;
+        uint32_t actualBaudRate = (F_CPU / BT_TIMER_PRESCALE_VALUE) / divisor / 3;
+    #endif
+
+    // Check that the baud rate produced is close enough for the module to understand
+    uint32_t error = (actualBaudRate > baudRate) ? actualBaudRate - baudRate : baudRate - actualBaudRate;
+    if (error * 100 > baudRate * BT_UART_MAX_BAUD_ERROR_PERCENT)
+        return 0;
+
+    return divisor;
+}
+
+uint8_t bt_setUARTBaudRate(const uint32_t baudRate) {
+    // Check that the baud rate can be used
+    uint32_t divisor = bt_uartBaudRateDivisor(baudRate);
+    if (!divisor)
+        return 0;
+
+    // Finish sending anything already queued at the old baud rate
+    bt_drain();
+
+    // Save the status register and disable interrupts so the ISR doesn't run partway through the change
+    uint8_t sregTemp = SREG;
+    cli();
+
+    #if BT_ENABLE_HARDWARE_UART
+        // Update the USART baud rate register
+        BT_USART_BAUD_REGISTER_HIGH = (uint8_t) ((divisor - 1) >> 8);
+        BT_USART_BAUD_REGISTER_LOW = (uint8_t) (divisor - 1);
+    #else
+        // Update the timer compare value and the number of ticks in a millisecond (rounded to the nearest tick)
+        uartTimerTop = divisor - 1;
+        uartMillisecondTicks = (((F_CPU / BT_TIMER_PRESCALE_VALUE / divisor) + 500) / 1000);
+        if (uartMillisecondCountTimer >= uartMillisecondTicks)
+            uartMillisecondCountTimer = 0;
+
+        // Restart the timer at the new rate (the edge-triggered receiver switches
+        // to the new rate the next time it stops idling)
+        #if BT_ENABLE_EDGE_TRIGGERED_RX
+            if (uartTimerActive) {
+                BT_TIMER_COMPARE_REGISTER = uartTimerTop;
+                BT_TIMER_COUNTER_REGISTER = 0;
+            }
+        #else
+            BT_TIMER_COMPARE_REGISTER = uartTimerTop;
+            BT_TIMER_COUNTER_REGISTER = 0;
+        #endif
+    #endif
+    uartBaudRate = baudRate;
+
+    // Restore the status register
+    SREG = sregTemp;
+    return 1;
+}
+
+uint32_t bt_getUARTBaudRate() {
+    // Save the status register and disable interrupts so the baud rate can't change partway through being read
+    uint8_t sregTemp = SREG;
+    cli();
+    uint32_t baudRate = uartBaudRate;
+    SREG = sregTemp;
+    return baudRate;
+}
+
+uint32_t bt_millis() {
+    // Save the status register and disable interrupts so the counter can't change partway through being read
+    uint8_t sregTemp = SREG;
+    cli();
+    uint32_t milliseconds = uartMillisecondCounter;
+    // Keep the timer running (or start it again) so the counter keeps counting while it's being watched
+    #if BT_ENABLE_LOW_POWER_IDLE
+        uartClockHold = BT_UART_CLOCK_HOLD_MS;
+        bt_uartWakeTimer();
+    #endif
+    SREG = sregTemp;
+    return milliseconds;
+}
+
+uint8_t bt_uartReceiverIdle() {
+    // The module has stopped sending once the receiver isn't reading a byte, and the packet wait time has passed
+    return !uartReceiverBusy && uartPacketWaitTimer >= BT_UART_PACKET_WAIT_MS;
+}
+
+// Allow for the low power idle toggle
+#if BT_ENABLE_LOW_POWER_IDLE
+
+    void bt_uartSleep() {
+        set_sleep_mode(BT_SLEEP_MODE);
+
+        // Only sleep if the timer is running (if it has stopped, whatever we're waiting for has already happened)
+        cli();
+        if (!uartTimerStopped) {
+            sleep_enable();
+            // The instruction after sei() always runs before any interrupt, so an interrupt can't
+            // slip in between the check above and going to sleep
+            sei();
+            sleep_cpu();
+            sleep_disable();
+        }
+        sei();
+    }
+
+#endif
+
 uint8_t bt_available() {
-    // Check if the most-recently read byte is the most recent input
-    return uartBufferInputIndex != uartBufferReadIndex;
+    // Check if there is any input that hasn't been read yet
+    return !bt_ringEmpty(&uartInputRing);
 }
 
 uint8_t bt_awaitAvailable() {
@@ -526,52 +1758,308 @@ uint8_t bt_awaitAvailable() {
     // and if not, check if the receiver is currently
     // reading a byte.  If so, wait for that bit to
     // be received
-    if (uartBufferInputIndex != uartBufferReadIndex) {
+    if (!bt_ringEmpty(&uartInputRing)) {
         return 1;
     } else {
         // Wait for the receiver to finish reading a byte (if it currently is) and wait for the configured amount of time
         // to verify there is no more data being sent
-        while ((uartReceiverBusy || uartPacketWaitTimer < BT_UART_PACKET_WAIT_TICKS) && (uartBufferInputIndex == uartBufferReadIndex));
+        while (!bt_uartReceiverIdle() && bt_ringEmpty(&uartInputRing))
+            bt_uartWait();
 
         // Now that the receiver is done or has read a bit, check again for availability
-        return uartBufferInputIndex != uartBufferReadIndex;
+        return !bt_ringEmpty(&uartInputRing);
     }
 }
 
+// This function makes sure the USART (or the idling timer) knows there is data to send
+static void bt_uartStartTransmitter() {
+    #if BT_ENABLE_HARDWARE_UART
+        BT_USART_CONTROL_REGISTER_B |= BT_USART_UDRE_INTERRUPT_MASK;
+    #elif BT_ENABLE_EDGE_TRIGGERED_RX
+        if (!uartTimerActive) {
+            uint8_t sregTemp = SREG;
+            cli();
+            // Check again now that the timer can't change underneath us
+            if (!uartTimerActive)
+                bt_uartActivateTimer(0);
+            SREG = sregTemp;
+        }
+    #endif
+}
+
 void bt_write(const uint8_t byte) {
-    // Wait for the transmitter to finish its work
-    while (uartTransmitterBusy); // TODO - timeout?
+    // Wait for space in the output buffer
+    while (!bt_tryWrite(byte)) // TODO - timeout?
+        bt_uartWait();
+}
+
+uint8_t bt_tryWrite(const uint8_t byte) {
+    // Queue the byte (if the output buffer is full, it can't be queued)
+    if (!bt_ringPush(&uartOutputRing, byte))
+        return 0;
 
-    // Set up transmitter to transmit the byte
-    uartTransmitterCounter = 3;
-    uartTxBitsRemaining = BT_UART_TX_BITS;
-    // Transform the byte into a UART packet
-    uartTxBitBuffer = (byte << 1) | 0x200;
-    // Notify transmitter there is a byte available
-    uartTransmitterBusy = 1;
+    // Keep track of the most bytes that have been waiting in the output buffer
+    #if BT_ENABLE_STATISTICS
+        bt_ring_index count = bt_ringCount(&uartOutputRing);
+        if (count > uartStats.txHighWater)
+            uartStats.txHighWater = count;
+    #endif
+
+    bt_uartStartTransmitter();
+    return 1;
+}
+
+void bt_writeBuffer(const uint8_t* data, size_t length) {
+    // Send the block as a single region
+    bt_iovec segment = { data, length };
+    bt_writev(&segment, 1);
+}
+
+void bt_writev(const bt_iovec* segments, size_t segmentCount) {
+    while (segmentCount > 0) {
+        // Only one set of regions can be queued at a time, so wait for the previous set to be handed off
+        while (uartTxJobActive)
+            bt_uartWait();
+
+        // Copy as many region descriptions as the transmitter can hold
+        uint8_t count = (uint8_t) min(segmentCount, BT_UART_TX_MAX_SEGMENTS);
+        uint8_t first = count;
+        for (uint8_t i = 0; i < count; i++) {
+            uartTxSegments[i] = segments[i];
+            // Keep track of the first region that isn't empty
+            if (first == count && segments[i].length > 0)
+                first = i;
+        }
+        segments += count;
+        segmentCount -= count;
+
+        // If every region was empty, there's nothing to send
+        if (first == count)
+            continue;
+
+        // Set up the first region, then mark the regions as queued (so the transmitter sees a complete job)
+        uartTxJobSegmentCount = count;
+        uartTxJobSegment = first;
+        uartTxJobData = uartTxSegments[first].data;
+        uartTxJobRemaining = uartTxSegments[first].length;
+        uartTxJobStart = uartOutputRing.head;
+        uartTxJobActive = 1;
+
+        bt_uartStartTransmitter();
+    }
+}
+
+uint8_t bt_writeComplete() {
+    // The regions can be reused once every byte has been handed to the transmitter
+    return !uartTxJobActive;
+}
+
+size_t bt_txPending() {
+    // Count the bytes waiting in the output buffer
+    size_t pending = bt_ringCount(&uartOutputRing);
+
+    // Count the bytes left in the regions queued by bt_writev()
+    if (uartTxJobActive) {
+        // Save the status register and disable interrupts so the regions don't change while they're counted
+        uint8_t sregTemp = SREG;
+        cli();
+        if (uartTxJobActive) {
+            pending += uartTxJobRemaining;
+            for (uint8_t segment = uartTxJobSegment + 1; segment < uartTxJobSegmentCount; segment++)
+                pending += uartTxSegments[segment].length;
+        }
+        SREG = sregTemp;
+    }
+
+    // Include the byte currently being sent (if there is one)
+    #if BT_ENABLE_HARDWARE_UART
+        // The USART sets its transmit complete flag once the last byte has been shifted out
+        return pending + (uartTransmitterBusy && !(BT_USART_CONTROL_REGISTER_A & BT_USART_TX_COMPLETE_MASK));
+    #else
+        return pending + uartTransmitterBusy;
+    #endif
+}
+
+void bt_drain() {
+    // Wait for the output buffer to empty and the last byte to be sent
+    while (bt_txPending())
+        bt_uartWait();
 }
 
 uint8_t bt_read() {
-    // If we haven't read any new characters, return \0
-    if (uartBufferInputIndex == uartBufferReadIndex)
+    // Pull the oldest byte from the input buffer (if we haven't read any new characters, return \0)
+    uint8_t in;
+    if (!bt_ringPop(&uartInputRing, &in))
         return 0;
 
-    // Pull the latest byte from the input buffer
-    uint8_t in = uartInputBuffer[uartBufferReadIndex];
-    // Increment the read index (wrapping if it exceeds the buffer size)
-    if (++uartBufferReadIndex >= BT_UART_RX_BUFFER_LENGTH)
-        uartBufferReadIndex = 0;
-    
+    // Keep the line count up to date if a delimiter was removed
+    #if BT_ENABLE_LINE_MODE
+        if (in == BT_LINE_DELIMITER)
+            uartLinesRead++;
+    #endif
+
     // Return the byte
     return in; 
 }
 
+size_t bt_availableBytes() {
+    // Count the input that hasn't been read yet
+    return bt_ringCount(&uartInputRing);
+}
+
+uint8_t bt_peek(const size_t offset) {
+    // Read the byte without removing it (if it hasn't been received, return \0)
+    uint8_t in;
+    if (offset >= BT_UART_RX_BUFFER_LENGTH || !bt_ringPeek(&uartInputRing, (bt_ring_index) offset, &in))
+        return 0;
+
+    return in;
+}
+
+void bt_rxSpan(const uint8_t** data, size_t* length) {
+    volatile uint8_t* span;
+    *length = bt_ringSpan(&uartInputRing, &span);
+    // The receiver won't touch these bytes until they're consumed, so they can be treated as non-volatile
+    *data = (const uint8_t*) span;
+}
+
+void bt_consume(const size_t count) {
+    bt_ring_index consumeCount = (bt_ring_index) min(count, BT_UART_RX_BUFFER_LENGTH);
+
+    // Keep the line count up to date by counting the delimiters being removed.  Only the bytes that were
+    // checked are removed, so a delimiter that arrives after the check can't be removed without being counted
+    #if BT_ENABLE_LINE_MODE
+        uint8_t in;
+        bt_ring_index offset;
+        for (offset = 0; offset < consumeCount && bt_ringPeek(&uartInputRing, offset, &in); offset++) {
+            if (in == BT_LINE_DELIMITER)
+                uartLinesRead++;
+        }
+        consumeCount = offset;
+    #endif
+
+    // Release the bytes back to the receiver (limited to the bytes that are available)
+    bt_ringConsume(&uartInputRing, consumeCount);
+}
+
 void bt_flush() {
-    // Reset read indexes
-    uartBufferInputIndex = 0;
-    uartBufferReadIndex = 0;
+    // Discard everything up to the receiver's current position
+    // (only the read index is moved, so this is safe while the receiver is running)
+    #if BT_ENABLE_LINE_MODE
+        // Remove the bytes the same way as bt_consume(), so the delimiters removed are counted
+        bt_consume(bt_ringCount(&uartInputRing));
+    #else
+        bt_ringFlush(&uartInputRing);
+    #endif
 }
 
+// Allow for the line mode toggle
+#if BT_ENABLE_LINE_MODE
+
+    size_t bt_linesAvailable() {
+        // Count the delimiters stored that haven't been removed yet
+        return (bt_ring_index) (bt_ringLoadIndex(&uartLinesReceived) - uartLinesRead);
+    }
+
+    size_t bt_readLine(char* buffer, size_t bufferLength) {
+        // If there isn't a complete line waiting, there's nothing to return
+        // (unless the input buffer is full, in which case the line will never fit, so return what's there)
+        if (!bt_linesAvailable() && bt_ringCount(&uartInputRing) < BT_UART_RX_BUFFER_LENGTH)
+            return BT_LINE_NONE;
+
+        // Copy bytes straight out of the input buffer until the delimiter is reached
+        size_t bufferIndex = 0;
+        uint8_t delimiterFound = 0;
+        const uint8_t* data;
+        size_t length;
+        bt_rxSpan(&data, &length);
+        while (!delimiterFound && length > 0) {
+            // Look for the delimiter in the bytes that are stored next to each other
+            const uint8_t* delimiterPosition = memchr(data, BT_LINE_DELIMITER, length);
+            size_t lineLength = delimiterPosition ? (size_t) (delimiterPosition - data) : length;
+
+            // Copy as much as fits (leaving room for the null-terminator).  If we overflow the buffer,
+            // the rest of the line is still removed from the input so the next line can be read
+            size_t copyLength = (bufferLength > 0) ? min(lineLength, bufferLength - 1 - bufferIndex) : 0;
+            memcpy(buffer + bufferIndex, data, copyLength);
+            bufferIndex += copyLength;
+
+            // If we've reached the delimiter, remove it too and stop
+            if (delimiterPosition) {
+                lineLength++;
+                delimiterFound = 1;
+                uartLinesRead++;
+            }
+            bt_ringConsume(&uartInputRing, (bt_ring_index) lineLength);
+            bt_rxSpan(&data, &length);
+        }
+        if (bufferLength > 0)
+            buffer[bufferIndex] = '\0';
+
+        return bufferIndex;
+    }
+
+#endif
+
+// Allow for the statistics toggle
+#if BT_ENABLE_STATISTICS
+
+    void bt_getStats(bt_stats* stats) {
+        // Save the status register and disable interrupts so the counters don't change while they're copied
+        uint8_t sregTemp = SREG;
+        cli();
+        *stats = uartStats;
+        SREG = sregTemp;
+    }
+
+    void bt_resetStats() {
+        static const bt_stats emptyStats;
+
+        // Save the status register and disable interrupts so the ISR doesn't count anything partway through
+        uint8_t sregTemp = SREG;
+        cli();
+        uartStats = emptyStats;
+        SREG = sregTemp;
+    }
+
+    void bt_statsATTimeout() {
+        // Only the AT command functions change this counter (never the ISR), so interrupts don't need to be disabled
+        uartStats.atTimeouts++;
+    }
+
+#endif
+
+// Allow for the ISR profiling toggle
+#if BT_ENABLE_ISR_PROFILING
+
+    void bt_getISRProfile(bt_isr_profile* profile) {
+        // Save the status register and disable interrupts so the measurements don't change while they're copied
+        uint8_t sregTemp = SREG;
+        cli();
+        *profile = uartProfile;
+        SREG = sregTemp;
+
+        // Flag the paths that have taken longer than the time between ticks
+        profile->budgetCycles = (uartTimerTop + 1) * BT_TIMER_PRESCALE_VALUE;
+        profile->overBudgetPaths = 0;
+        for (uint8_t path = 0; path < BT_ISR_PATH_COUNT; path++) {
+            if (profile->maxCycles[path] > profile->budgetCycles)
+                profile->overBudgetPaths |= (1 << path);
+        }
+    }
+
+    void bt_resetISRProfile() {
+        static const bt_isr_profile emptyProfile;
+
+        // Save the status register and disable interrupts so the ISR doesn't record anything partway through
+        uint8_t sregTemp = SREG;
+        cli();
+        uartProfile = emptyProfile;
+        SREG = sregTemp;
+    }
+
+#endif
+
 /*
  *   ___    __ ___      _   _  _    _  _  _  _    _          
  *  |_ _|  / // _ \    | | | || |_ (_)| |(_)| |_ (_) ___  ___
@@ -598,28 +2086,277 @@ void bt_flush() {
     }
 
     size_t bt_readString(const char delimiter, char* buffer, size_t bufferLength) {
-        // Read bytes to fill the given buffer
+        // Copy bytes straight out of the input buffer to fill the given buffer
         size_t bufferIndex = 0;
-        char input;
-        while (bt_awaitAvailable() && bufferIndex < bufferLength - 1) {
-            input = (char) bt_read();
+        uint8_t delimiterFound = 0;
+        const uint8_t* data;
+        size_t length;
+        while (!delimiterFound && bt_awaitAvailable()) {
+            bt_rxSpan(&data, &length);
+
+            // Look for the delimiter in the bytes that are ready
+            const uint8_t* delimiterPosition = memchr(data, delimiter, length);
+            size_t stringLength = delimiterPosition ? (size_t) (delimiterPosition - data) : length;
+
+            // Copy as much as fits (leaving room for the null-terminator).  If we overflow
+            // the buffer, the remaining bytes up to the delimiter are still removed from
+            // the input so the UART stream can handle further input
+            size_t copyLength = min(stringLength, bufferLength - 1 - bufferIndex);
+            memcpy(buffer + bufferIndex, data, copyLength);
+            bufferIndex += copyLength;
+
+            // If we've reached a delimiter, remove it too and stop
+            if (delimiterPosition) {
+                stringLength++;
+                delimiterFound = 1;
+            }
+            bt_consume(stringLength);
+        }
+        buffer[bufferIndex] = '\0';
 
-            // If we've reached a delimiter, break
-            if (input == delimiter)
-                break;
+        return bufferIndex;
+    }
 
-            buffer[bufferIndex++] = input;
+    // Allow for the compression function toggle
+    #if BT_ENABLE_COMPRESSION_FUNCTIONS
+
+        /*
+        * ------------------------------------------------------------------
+        * Utility functions for sending compressed data via the UART stream:
+        * ------------------------------------------------------------------
+        */
+
+        // These globals track the stream being compressed by bt_compressWrite()
+        // The bytes that have already been compressed (the window that repeats are found in)
+        static uint8_t  compressWindow[BT_COMPRESSION_WINDOW_LENGTH];
+        static uint8_t  compressWindowHead;
+        // The bytes waiting to be compressed
+        static uint8_t  compressLookahead[BT_COMPRESSION_MAX_MATCH];
+        static uint8_t  compressLookaheadLength;
+        // The bits that haven't filled a whole byte yet (the lowest compressBitCount bits)
+        static uint32_t compressBits;
+        static uint8_t  compressBitCount;
+        // The blocks of compressed bytes (one is filled while the other is sent)
+        static uint8_t  compressBlocks[2][BT_COMPRESSION_BLOCK_LENGTH];
+        static uint8_t  compressBlock;
+        static uint8_t  compressBlockLength;
+        // The number of bytes given to the compressor, and the number of compressed bytes sent
+        static uint32_t compressInputBytes;
+        static uint32_t compressOutputBytes;
+
+        // These globals track the stream being decompressed by bt_decompressRead()
+        // The bytes that have already been decompressed (the window that repeats are copied from)
+        static uint8_t  decompressWindow[BT_COMPRESSION_WINDOW_LENGTH];
+        static uint8_t  decompressWindowHead;
+        // The bits that have been read but not used yet (the lowest decompressBitCount bits)
+        static uint32_t decompressBits;
+        static uint8_t  decompressBitCount;
+        // The repeat being copied (if the buffer filled up partway through it)
+        static uint8_t  decompressMatchDistance;
+        static uint8_t  decompressMatchRemaining;
+        // Whether the end of the stream has been read
+        static uint8_t  decompressEnded;
+
+        // This function sends the block currently being filled (as a single region) and starts filling the other one.
+        // bt_writev() waits for the previous block to be handed to the transmitter first, so the other block is free
+        static void bt_compressSendBlock() {
+            if (compressBlockLength == 0)
+                return;
+
+            bt_writeBuffer(compressBlocks[compressBlock], compressBlockLength);
+            compressOutputBytes += compressBlockLength;
+            compressBlock ^= 1;
+            compressBlockLength = 0;
         }
-        buffer[bufferIndex] = '\0';
 
-        // If we've not reached the delimiter and there are still bytes available
-        // (e.g. we overflowed the buffer), read the remaining bytes to clear the input
-        // so the UART stream can handle further input
-        if (bt_available())
-            while (bt_awaitAvailable() && (input = bt_read()) != delimiter);
+        // This function adds the lowest bits of a value to the output (most significant bit first)
+        static void bt_compressWriteBits(const uint16_t value, const uint8_t bits) {
+            compressBits = (compressBits << bits) | value;
+            compressBitCount += bits;
+            while (compressBitCount >= 8) {
+                compressBitCount -= 8;
+                compressBlocks[compressBlock][compressBlockLength++] = (uint8_t) (compressBits >> compressBitCount);
+                if (compressBlockLength == BT_COMPRESSION_BLOCK_LENGTH)
+                    bt_compressSendBlock();
+            }
+        }
 
-        return strlen(buffer);
-    }
+        // This function finds a byte relative to the first byte waiting to be compressed
+        // (negative positions are in the window, the rest are waiting to be compressed)
+        static inline uint8_t bt_compressByteAt(const int16_t position) {
+            if (position >= 0)
+                return compressLookahead[position];
+            return compressWindow[(compressWindowHead + position) & BT_COMPRESSION_WINDOW_MASK];
+        }
+
+        // This function compresses the bytes at the start of the lookahead (as a repeat if one
+        // can be found in the window, or as a literal byte otherwise)
+        static void bt_compressToken() {
+            // Find the longest repeat in the window.  A repeat can run on past the end of the window
+            // into the bytes being compressed, since they're copied one at a time when decompressed
+            uint8_t bestLength = 0;
+            uint8_t bestDistance = 0;
+            for (uint16_t distance = 1; distance < BT_COMPRESSION_WINDOW_LENGTH; distance++) {
+                uint8_t length = 0;
+                while (length < compressLookaheadLength && bt_compressByteAt(length - distance) == compressLookahead[length])
+                    length++;
+                if (length > bestLength) {
+                    bestLength = length;
+                    bestDistance = (uint8_t) distance;
+                    // Stop once no longer repeat can be found
+                    if (length == compressLookaheadLength)
+                        break;
+                }
+            }
+
+            // Send a repeat (a 0 bit, the distance back, and the length) if it takes fewer bits than the
+            // literal bytes would, or a literal (a 1 bit and the byte) otherwise
+            uint8_t consumed;
+            if (bestLength >= BT_COMPRESSION_MIN_MATCH) {
+                bt_compressWriteBits(((uint16_t) bestDistance << BT_COMPRESSION_LENGTH_BITS) | (bestLength - BT_COMPRESSION_MIN_MATCH), BT_COMPRESSION_MATCH_BITS);
+                consumed = bestLength;
+            } else {
+                bt_compressWriteBits(BT_COMPRESSION_LITERAL_FLAG | compressLookahead[0], BT_COMPRESSION_LITERAL_BITS);
+                consumed = 1;
+            }
+
+            // Move the bytes that were sent into the window
+            for (uint8_t i = 0; i < consumed; i++) {
+                compressWindow[compressWindowHead] = compressLookahead[i];
+                compressWindowHead = (compressWindowHead + 1) & BT_COMPRESSION_WINDOW_MASK;
+            }
+            compressLookaheadLength -= consumed;
+            memmove(compressLookahead, compressLookahead + consumed, compressLookaheadLength);
+        }
+
+        void bt_compressBegin() {
+            // Start with an empty window (both ends treat it as all zeros)
+            memset(compressWindow, 0, BT_COMPRESSION_WINDOW_LENGTH);
+            compressWindowHead = 0;
+            compressLookaheadLength = 0;
+            compressBitCount = 0;
+            compressBlockLength = 0;
+            compressInputBytes = 0;
+            compressOutputBytes = 0;
+        }
+
+        void bt_compressWrite(const uint8_t* data, size_t length) {
+            compressInputBytes += length;
+
+            // Collect the bytes, compressing them once there are enough to find the longest possible repeat
+            while (length > 0) {
+                compressLookahead[compressLookaheadLength++] = *data++;
+                length--;
+                if (compressLookaheadLength == BT_COMPRESSION_MAX_MATCH)
+                    bt_compressToken();
+            }
+        }
+
+        uint16_t bt_compressEnd() {
+            // Compress the bytes that are left
+            while (compressLookaheadLength > 0)
+                bt_compressToken();
+
+            // Mark the end of the stream (a repeat with a distance of 0), pad the last byte with zeros,
+            // and send the last block (waiting for the transmitter to finish with it)
+            bt_compressWriteBits(0, BT_COMPRESSION_END_BITS);
+            if (compressBitCount > 0)
+                bt_compressWriteBits(0, 8 - compressBitCount);
+            bt_compressSendBlock();
+            while (!bt_writeComplete())
+                bt_uartWait();
+
+            // Work out the size of the compressed stream compared to the original bytes
+            if (compressInputBytes == 0)
+                return 0;
+            return (uint16_t) min(compressOutputBytes * 100 / compressInputBytes, 0xFFFF);
+        }
+
+        // This function makes sure there are at least the given number of bits to use (reading bytes as needed).
+        // If a byte doesn't arrive, 0 is returned (and the bits read so far are kept for the next call)
+        static uint8_t bt_decompressFill(const uint8_t bits) {
+            while (decompressBitCount < bits) {
+                if (!bt_awaitAvailable())
+                    return 0;
+                decompressBits = (decompressBits << 8) | bt_read();
+                decompressBitCount += 8;
+            }
+            return 1;
+        }
+
+        // This function returns the next bits to be used (without using them up)
+        static inline uint16_t bt_decompressPeek(const uint8_t bits) {
+            return (uint16_t) (decompressBits >> (decompressBitCount - bits)) & ((1U << bits) - 1);
+        }
+
+        // This function adds a decompressed byte to the window
+        static inline void bt_decompressPush(const uint8_t byte) {
+            decompressWindow[decompressWindowHead] = byte;
+            decompressWindowHead = (decompressWindowHead + 1) & BT_COMPRESSION_WINDOW_MASK;
+        }
+
+        void bt_decompressBegin() {
+            // Start with an empty window (matching the compressor)
+            memset(decompressWindow, 0, BT_COMPRESSION_WINDOW_LENGTH);
+            decompressWindowHead = 0;
+            decompressBitCount = 0;
+            decompressMatchRemaining = 0;
+            decompressEnded = 0;
+        }
+
+        size_t bt_decompressRead(uint8_t* buffer, size_t bufferLength) {
+            size_t length = 0;
+            while (length < bufferLength) {
+                // Finish copying the current repeat before reading anything else
+                if (decompressMatchRemaining > 0) {
+                    uint8_t byte = decompressWindow[(decompressWindowHead - decompressMatchDistance) & BT_COMPRESSION_WINDOW_MASK];
+                    bt_decompressPush(byte);
+                    buffer[length++] = byte;
+                    decompressMatchRemaining--;
+                    continue;
+                }
+
+                // Stop once the end of the stream has been reached, or the next token hasn't arrived yet.
+                // Each token is only used up once all of its bits have arrived
+                if (decompressEnded || !bt_decompressFill(1))
+                    break;
+                if (bt_decompressPeek(1)) {
+                    // Copy a literal byte
+                    if (!bt_decompressFill(BT_COMPRESSION_LITERAL_BITS))
+                        break;
+                    uint8_t byte = (uint8_t) bt_decompressPeek(BT_COMPRESSION_LITERAL_BITS);
+                    decompressBitCount -= BT_COMPRESSION_LITERAL_BITS;
+                    bt_decompressPush(byte);
+                    buffer[length++] = byte;
+                } else {
+                    // Check for the end of the stream (a distance of 0), skipping the padding after it
+                    if (!bt_decompressFill(BT_COMPRESSION_END_BITS))
+                        break;
+                    uint8_t distance = (uint8_t) bt_decompressPeek(BT_COMPRESSION_END_BITS);
+                    if (distance == 0) {
+                        decompressBitCount = 0;
+                        decompressEnded = 1;
+                        break;
+                    }
+
+                    // Start copying a repeat
+                    if (!bt_decompressFill(BT_COMPRESSION_MATCH_BITS))
+                        break;
+                    decompressMatchDistance = distance;
+                    decompressMatchRemaining = (bt_decompressPeek(BT_COMPRESSION_MATCH_BITS) & BT_COMPRESSION_LENGTH_MASK) + BT_COMPRESSION_MIN_MATCH;
+                    decompressBitCount -= BT_COMPRESSION_MATCH_BITS;
+                }
+            }
+
+            return length;
+        }
+
+        uint8_t bt_decompressComplete() {
+            // The stream is complete once its end has been read and the last repeat has been copied
+            return decompressEnded && decompressMatchRemaining == 0;
+        }
+
+    #endif
 
     /*
     * -----------------------------------------------------------
@@ -746,4 +2483,369 @@ void bt_flush() {
         return value;
     }
 
+    // These functions zigzag-encode/decode an integer (moving the sign into the lowest
+    // bit), so values close to 0 have few significant bits whether they're positive or negative
+    static inline uint32_t bt_zigzagEncode(const int32_t value) {
+        return ((uint32_t) value << 1) ^ -((uint32_t) (value < 0));
+    }
+
+    static inline int32_t bt_zigzagDecode(const uint32_t value) {
+        return (int32_t) ((value >> 1) ^ -(value & 0x01));
+    }
+
+    void bt_writeVarUInt32(uint32_t value) {
+        // Write 7 bits at a time (least significant bits first), setting
+        // the top bit of each byte if there are more bits to follow
+        while (value > BT_VARINT_PAYLOAD_MASK) {
+            bt_write((uint8_t) (value & BT_VARINT_PAYLOAD_MASK) | BT_VARINT_CONTINUE_MASK);
+            value >>= 7;
+        }
+        bt_write((uint8_t) value);
+    }
+
+    uint32_t bt_readVarUInt32() {
+        // Read 7 bits at a time until a byte without the top bit set arrives
+        uint32_t value = 0;
+        for (uint8_t shift = 0; shift < 32; shift += 7) {
+            if (!bt_awaitAvailable())
+                return 0;
+            uint8_t byte = bt_read();
+            value |= (uint32_t) (byte & BT_VARINT_PAYLOAD_MASK) << shift;
+            if (!(byte & BT_VARINT_CONTINUE_MASK))
+                break;
+        }
+        return value;
+    }
+
+    void bt_writeVarInt32(int32_t value) {
+        // Zigzag-encode the integer so small negative values stay small
+        bt_writeVarUInt32(bt_zigzagEncode(value));
+    }
+
+    int32_t bt_readVarInt32() {
+        // Undo the zigzag encoding
+        return bt_zigzagDecode(bt_readVarUInt32());
+    }
+
+    /*
+    * ----------------------------------------------------------
+    * Utility functions for sending records via the UART stream:
+    * ----------------------------------------------------------
+    */
+
+    // This function finds where a byte of a field is stored in the struct (given its position in the stream)
+    static inline uint8_t bt_recordByteOffset(const bt_record_field* field, const uint8_t index) {
+        #if BT_RECORD_REVERSE_BYTES
+            // Integers are stored in the opposite order they're sent, so count back from the end of the field
+            if (field->ordered)
+                return field->offset + field->size - 1 - index;
+        #endif
+        return field->offset + index;
+    }
+
+    uint8_t bt_writeRecord(const bt_record_schema* schema, const void* record) {
+        // Pack the fields into a single block, in the order given by the schema
+        const uint8_t* bytes = (const uint8_t*) record;
+        uint8_t packed[BT_RECORD_MAX_LENGTH];
+        uint8_t length = 0;
+        for (uint8_t i = 0; i < schema->fieldCount; i++) {
+            const bt_record_field* field = &schema->fields[i];
+            // Make sure the field fits before packing it
+            if (field->size > BT_RECORD_MAX_LENGTH - length)
+                return 0;
+            for (uint8_t index = 0; index < field->size; index++)
+                packed[length++] = bytes[bt_recordByteOffset(field, index)];
+        }
+
+        // Send the block as a single region, then wait for the transmitter
+        // to finish with it (the block is gone once we return)
+        bt_writeBuffer(packed, length);
+        while (!bt_writeComplete())
+            bt_uartWait();
+
+        return 1;
+    }
+
+    uint8_t bt_readRecord(const bt_record_schema* schema, void* record) {
+        // Read each byte straight into its place in the struct
+        uint8_t* bytes = (uint8_t*) record;
+        uint8_t complete = 1;
+        for (uint8_t i = 0; i < schema->fieldCount; i++) {
+            const bt_record_field* field = &schema->fields[i];
+            for (uint8_t index = 0; index < field->size; index++) {
+                // Once a byte doesn't arrive, fill the rest of the record with zeros
+                if (complete && !bt_awaitAvailable())
+                    complete = 0;
+                bytes[bt_recordByteOffset(field, index)] = complete ? bt_read() : 0x0;
+            }
+        }
+
+        return complete;
+    }
+
+#endif
+
+// Allow for the batch function toggle
+#if BT_ENABLE_BATCH_FUNCTIONS
+
+    /*
+    * ----------------------------------------------------------
+    * Utility functions for sending samples via the UART stream:
+    * ----------------------------------------------------------
+    */
+
+    // These globals hold the bits of the byte currently being packed/unpacked
+    static uint8_t batchBitBuffer;
+    static uint8_t batchBitCount;
+
+    // This function adds the lowest bits of a value to the stream (most significant bit first),
+    // sending each byte once it's full
+    static void bt_batchWriteBits(const uint32_t value, uint8_t bits) {
+        while (bits > 0) {
+            bits--;
+            batchBitBuffer = (batchBitBuffer << 1) | ((value >> bits) & 0x01);
+            if (++batchBitCount == 8) {
+                bt_write(batchBitBuffer);
+                batchBitCount = 0;
+            }
+        }
+    }
+
+    // This function takes bits from the stream (most significant bit first), reading each byte once
+    // the last one has been used up.  If a byte doesn't arrive, 0 is returned
+    static uint8_t bt_batchReadBits(uint32_t* value, uint8_t bits) {
+        *value = 0;
+        while (bits > 0) {
+            if (batchBitCount == 0) {
+                if (!bt_awaitAvailable())
+                    return 0;
+                batchBitBuffer = bt_read();
+                batchBitCount = 8;
+            }
+            bits--;
+            batchBitCount--;
+            *value = (*value << 1) | ((batchBitBuffer >> batchBitCount) & 0x01);
+        }
+        return 1;
+    }
+
+    // This function finds the difference between two samples.  The difference wraps around
+    // like the samples do, so it always fits in 16 bits (and adding it back undoes it exactly)
+    static inline int16_t bt_batchDelta(const int16_t previous, const int16_t current) {
+        return (int16_t) ((uint16_t) current - (uint16_t) previous);
+    }
+
+    void bt_batchInit(bt_batch* batch, const uint8_t channels) {
+        // Start with an empty batch
+        batch->channels = min(channels, BT_BATCH_MAX_CHANNELS);
+        batch->count = 0;
+    }
+
+    uint8_t bt_batchAdd(bt_batch* batch, const int16_t* values) {
+        // Store a sample for each channel
+        for (uint8_t channel = 0; channel < batch->channels; channel++)
+            batch->samples[channel][batch->count] = values[channel];
+        batch->count++;
+
+        // Once the batch is full, send it
+        if (batch->count < BT_BATCH_MAX_SAMPLES)
+            return 0;
+        bt_sendBatch(batch);
+        return 1;
+    }
+
+    void bt_sendBatch(bt_batch* batch) {
+        // If there are no samples, there's nothing to send
+        if (batch->count == 0)
+            return;
+
+        // Send the header
+        bt_write(batch->count);
+        bt_write(batch->channels);
+
+        for (uint8_t channel = 0; channel < batch->channels; channel++) {
+            const int16_t* samples = batch->samples[channel];
+
+            // Find the number of bits needed by the largest difference between samples
+            uint32_t deltaBits = 0;
+            for (uint8_t i = 1; i < batch->count; i++)
+                deltaBits |= bt_zigzagEncode(bt_batchDelta(samples[i - 1], samples[i]));
+            uint8_t width = 0;
+            while (deltaBits) {
+                width++;
+                deltaBits >>= 1;
+            }
+
+            // Send the first sample and the width, followed by the differences (packed
+            // together, with the last byte padded with zeros)
+            bt_writeInt16(samples[0]);
+            bt_write(width);
+            batchBitCount = 0;
+            for (uint8_t i = 1; i < batch->count; i++)
+                bt_batchWriteBits(bt_zigzagEncode(bt_batchDelta(samples[i - 1], samples[i])), width);
+            if (batchBitCount > 0)
+                bt_write(batchBitBuffer << (8 - batchBitCount));
+        }
+
+        // Start the next batch
+        batch->count = 0;
+    }
+
+    uint8_t bt_receiveBatch(bt_batch* batch) {
+        batch->count = 0;
+
+        // Read the header, and make sure the batch can hold the samples
+        if (!bt_awaitAvailable())
+            return 0;
+        uint8_t count = bt_read();
+        if (!bt_awaitAvailable())
+            return 0;
+        uint8_t channels = bt_read();
+        if (count == 0 || count > BT_BATCH_MAX_SAMPLES || channels == 0 || channels > BT_BATCH_MAX_CHANNELS)
+            return 0;
+        batch->channels = channels;
+
+        for (uint8_t channel = 0; channel < channels; channel++) {
+            int16_t* samples = batch->samples[channel];
+
+            // Read the first sample and the width of the differences
+            samples[0] = bt_readInt16();
+            if (!bt_awaitAvailable())
+                return 0;
+            uint8_t width = bt_read();
+            if (width > BT_BATCH_MAX_DELTA_BITS)
+                return 0;
+
+            // Add each difference to the sample before it
+            batchBitCount = 0;
+            for (uint8_t i = 1; i < count; i++) {
+                uint32_t delta;
+                if (!bt_batchReadBits(&delta, width))
+                    return 0;
+                samples[i] = (int16_t) ((uint16_t) samples[i - 1] + (uint16_t) bt_zigzagDecode(delta));
+            }
+        }
+
+        batch->count = count;
+        return count;
+    }
+
+#endif
+
+// Allow for the frame function toggle
+#if BT_ENABLE_FRAME_FUNCTIONS
+
+    /*
+    * ---------------------------------------------------------
+    * Utility functions for sending frames via the UART stream:
+    * ---------------------------------------------------------
+    */
+
+    // These globals track the frame currently being received by bt_receiveFrame()
+    // The part of the frame being read (see BT_FRAME_STATE_*)
+    static uint8_t  frameState = BT_FRAME_STATE_DELIMITER;
+    // The number of bytes in the frame, and the number read so far
+    static uint8_t  frameLength;
+    static uint8_t  frameIndex;
+    // The CRC calculated from the bytes read so far, and the CRC sent with the frame
+    static uint16_t frameCRC;
+    static uint16_t frameReceivedCRC;
+    // The bytes read so far
+    static uint8_t  frameBuffer[BT_FRAME_MAX_LENGTH];
+
+    // This function adds a byte to a CRC-16 (CCITT, polynomial 0x1021) without using a lookup table
+    static inline uint16_t bt_frameCRCUpdate(uint16_t crc, const uint8_t byte) {
+        uint8_t x = (crc >> 8) ^ byte;
+        x ^= x >> 4;
+        return (crc << 8) ^ ((uint16_t) x << 12) ^ ((uint16_t) x << 5) ^ x;
+    }
+
+    uint8_t bt_sendFrame(const uint8_t* data, const uint8_t length) {
+        // Check that the receiver will be able to hold the frame
+        if (length > BT_FRAME_MAX_LENGTH)
+            return 0;
+
+        // Calculate the CRC of the length and the bytes
+        uint16_t crc = bt_frameCRCUpdate(BT_FRAME_CRC_INITIAL, length);
+        for (uint8_t i = 0; i < length; i++)
+            crc = bt_frameCRCUpdate(crc, data[i]);
+
+        // Send the header, the bytes, and the CRC as regions (so the bytes aren't copied), then
+        // wait for the transmitter to finish with them (the header and CRC are gone once we return)
+        uint8_t header[2] = { BT_FRAME_DELIMITER, length };
+        uint8_t trailer[2] = { (uint8_t) (crc >> 8), (uint8_t) crc };
+        bt_iovec segments[3] = { { header, 2 }, { data, length }, { trailer, 2 } };
+        bt_writev(segments, 3);
+        while (!bt_writeComplete())
+            bt_uartWait();
+
+        return 1;
+    }
+
+    uint8_t bt_receiveFrame(uint8_t* buffer, size_t bufferLength, size_t* length) {
+        // Process the bytes received so far, one part of the frame at a time
+        while (bt_available()) {
+            uint8_t byte = bt_read();
+            switch (frameState) {
+                case BT_FRAME_STATE_DELIMITER:
+                    // Skip anything received outside of a frame
+                    if (byte == BT_FRAME_DELIMITER)
+                        frameState = BT_FRAME_STATE_LENGTH;
+                    break;
+
+                case BT_FRAME_STATE_LENGTH:
+                    // If the frame is too long to hold, drop it
+                    if (byte > BT_FRAME_MAX_LENGTH) {
+                        frameState = BT_FRAME_STATE_DELIMITER;
+                        return BT_FRAME_CORRUPT;
+                    }
+                    frameLength = byte;
+                    frameIndex = 0;
+                    frameCRC = bt_frameCRCUpdate(BT_FRAME_CRC_INITIAL, byte);
+                    frameState = (frameLength > 0) ? BT_FRAME_STATE_PAYLOAD : BT_FRAME_STATE_CRC_HIGH;
+                    break;
+
+                case BT_FRAME_STATE_PAYLOAD:
+                    frameBuffer[frameIndex++] = byte;
+                    frameCRC = bt_frameCRCUpdate(frameCRC, byte);
+                    if (frameIndex == frameLength)
+                        frameState = BT_FRAME_STATE_CRC_HIGH;
+                    break;
+
+                case BT_FRAME_STATE_CRC_HIGH:
+                    frameReceivedCRC = (uint16_t) byte << 8;
+                    frameState = BT_FRAME_STATE_CRC_LOW;
+                    break;
+
+                case BT_FRAME_STATE_CRC_LOW:
+                    // The frame is complete, so check the CRC, then start looking for the next frame
+                    frameState = BT_FRAME_STATE_DELIMITER;
+                    if ((frameReceivedCRC | byte) != frameCRC)
+                        return BT_FRAME_CORRUPT;
+
+                    // Copy as much of the frame as fits
+                    *length = min(frameLength, bufferLength);
+                    memcpy(buffer, frameBuffer, *length);
+                    return BT_FRAME_OK;
+            }
+        }
+
+        // If the module stopped sending partway through a frame, some of it was lost, so drop it
+        if (frameState != BT_FRAME_STATE_DELIMITER && bt_uartReceiverIdle()) {
+            frameState = BT_FRAME_STATE_DELIMITER;
+            return BT_FRAME_CORRUPT;
+        }
+
+        return BT_FRAME_PENDING;
+    }
+
+    uint8_t bt_awaitFrame(uint8_t* buffer, size_t bufferLength, size_t* length, const uint16_t timeoutMs) {
+        // Check for a frame until one is received/dropped, or the timeout is exceeded
+        uint32_t waitStart = bt_millis();
+        uint8_t result;
+        while ((result = bt_receiveFrame(buffer, bufferLength, length)) == BT_FRAME_PENDING && bt_millis() - waitStart < timeoutMs)
+            bt_uartWait();
+        return result;
+    }
+
 #endif
@@ -7,6 +7,7 @@
 #define BLUETOOTH_H
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "bluetooth_settings.h"
@@ -35,6 +36,25 @@
 // An secure, encrypted link is required (with man-in-the-middle protection)
 #define BT_AUTH_TYPE_SECURE_CONNECTION_LINK 3
 
+/*
+ * -------------------------------------------------------
+ * These constants are returned by the bt_atPoll function:
+ * -------------------------------------------------------
+ */
+
+// The command is still being sent, or the module hasn't finished responding
+#define BT_AT_PENDING 0
+// The module responded as expected
+#define BT_AT_OK      1
+// The module didn't respond, or responded with something unexpected
+#define BT_AT_FAIL    2
+// No command has been started
+#define BT_AT_IDLE    3
+
+// Define the prototype for the function called when an AT command started using bt_atBegin()
+// or bt_atBeginQuery() completes (the result is BT_AT_OK or BT_AT_FAIL)
+typedef void (*bt_at_callback)(uint8_t result);
+
 /*
  * ----------------------------------------------------------------
  * These constants/macros are for the UART stream and connectivity:
@@ -45,7 +65,9 @@
 // These can be used as follows:
 //   BT_ON_CONNECTION { /* ... */ }
 // The handlers are called from within the UART interrupt
-// service routine, so they should be designed accordingly.
+// service routine, so they should be designed accordingly
+// (unless BT_ENABLE_DEFERRED_EVENTS is enabled, in which case
+// they're called from bt_processEvents() instead).
 //
 // In order to use these handlers, they must be enabled
 // by setting BT_ENABLE_CONNECTION_HANDLER or
@@ -54,6 +76,172 @@
 #define BT_ON_CONNECTION    void bt_handler_onConnection()
 #define BT_ON_DISCONNECTION void bt_handler_onDisconnection()
 
+// Define the receive handler prototype
+// This can be used as follows:
+//   BT_ON_RECEIVE { /* ... */ return 1; }
+// The handler is called from within the UART interrupt service
+// routine as soon as each byte has been received (the byte is
+// available as 'byte').  If it returns 1, the byte has been
+// handled and is discarded.  If it returns 0, the byte is stored
+// in the input buffer to be read later, as usual.
+//
+// While the software UART is used, the handler runs in the
+// same interrupt that sends/receives each bit, so it must finish
+// well within one tick (see bt_getISRProfile()).
+//
+// In order to use this handler, it must be enabled by setting
+// BT_ENABLE_RECEIVE_HANDLER to 1 in the bluetooth_settings.h file.
+#define BT_ON_RECEIVE uint8_t bt_handler_onReceive(const uint8_t byte)
+
+// Define the structure used to describe a region of memory for bt_writev()
+typedef struct {
+    // The start of the region
+    const uint8_t* data;
+    // The number of bytes in the region
+    size_t length;
+} bt_iovec;
+
+/*
+ * ----------------------------------------------------------
+ * These constants are used by the bt_getISRProfile function:
+ * ----------------------------------------------------------
+ */
+
+// Nothing was sent or received during the tick
+#define BT_ISR_PATH_IDLE        0
+// A bit was sent
+#define BT_ISR_PATH_TX_BIT      1
+// A start bit or data bit was received
+#define BT_ISR_PATH_RX_BIT      2
+// A stop bit was received (and the byte was stored in the input buffer)
+#define BT_ISR_PATH_STOP_BIT    3
+// A millisecond elapsed (and the timeout counters were updated)
+#define BT_ISR_PATH_MILLISECOND 4
+// The State pin was checked (and the connection/disconnection handlers were run, if needed)
+#define BT_ISR_PATH_STATE_CHECK 5
+// The number of paths measured
+#define BT_ISR_PATH_COUNT       6
+
+// Define the structure used to report the timing of the UART timer ISR
+// Ticks that take several paths at once are counted under the path with the
+// highest number above (so each worst case includes everything that can happen
+// alongside that path)
+typedef struct {
+    // The number of CPU cycles between timer ticks (the most each tick can take)
+    uint16_t budgetCycles;
+    // The longest time taken by each path (in CPU cycles)
+    uint16_t maxCycles[BT_ISR_PATH_COUNT];
+    // The number of times each path was taken
+    uint32_t counts[BT_ISR_PATH_COUNT];
+    // The number of ticks that weren't finished before the next tick arrived
+    uint32_t overruns;
+    // Each bit is set if the path at that position has taken longer than budgetCycles
+    uint8_t overBudgetPaths;
+} bt_isr_profile;
+
+// Define the structure used to report the UART statistics (see bt_getStats())
+typedef struct {
+    // The number of bytes received (including bytes that were dropped or taken by the receive handler)
+    uint32_t rxBytes;
+    // The number of bytes sent
+    uint32_t txBytes;
+    // The number of bytes dropped because the input buffer was full (or the USART wasn't read in time)
+    uint32_t rxOverruns;
+    // The number of bytes received without a valid stop bit (usually caused by noise or a baud rate mismatch)
+    uint32_t framingErrors;
+    // The most bytes that have been waiting in the input/output buffers at once
+    uint16_t rxHighWater;
+    uint16_t txHighWater;
+    // The number of times a remote device has connected/disconnected
+    uint16_t connections;
+    uint16_t disconnections;
+    // The number of AT commands that didn't receive a response in time
+    uint16_t atTimeouts;
+} bt_stats;
+
+/*
+ * ---------------------------------------------------------
+ * These constants are returned by the bt_readLine function:
+ * ---------------------------------------------------------
+ */
+
+// A complete line hasn't been received yet (the input is left as it is)
+#define BT_LINE_NONE ((size_t) -1)
+
+/*
+ * -------------------------------------------------------------
+ * These constants are returned by the bt_receiveFrame function:
+ * -------------------------------------------------------------
+ */
+
+// No complete frame has been received yet
+#define BT_FRAME_PENDING 0
+// A frame was received (and its CRC matched)
+#define BT_FRAME_OK      1
+// A frame was dropped because it was corrupted (its CRC didn't match, it was too
+// long, or the module stopped sending partway through it)
+#define BT_FRAME_CORRUPT 2
+
+/*
+ * ------------------------------------------------------
+ * These constants/types are used by the software timers:
+ * ------------------------------------------------------
+ */
+
+// Returned by bt_startTimer() when every software timer is already scheduled
+#define BT_TIMER_NONE 0xFF
+
+// Define the prototype for the functions called by the software timers
+typedef void (*bt_timer_callback)();
+
+/*
+ * ----------------------------------------------------------------------
+ * These constants/types are used by the bt_[write/read]Record functions:
+ * ----------------------------------------------------------------------
+ */
+
+// Define the structure used to describe each field of a record (see BT_RECORD_FIELD())
+typedef struct {
+    // The position of the field in the struct (see offsetof())
+    uint8_t offset;
+    // The number of bytes in the field
+    uint8_t size;
+    // 1 if the field is an integer (sent in the order given by BT_UART_ENDIANNESS),
+    // 0 if its bytes are sent in the order they're stored (e.g. a character array)
+    uint8_t ordered;
+} bt_record_field;
+
+// Define the structure used to describe a record (see BT_RECORD_SCHEMA())
+typedef struct {
+    // The fields of the record, in the order they're sent
+    const bt_record_field* fields;
+    // The number of fields in the record
+    uint8_t fieldCount;
+} bt_record_schema;
+
+// Describe an integer member of a struct (e.g. BT_RECORD_FIELD(reading, temperature))
+#define BT_RECORD_FIELD(type, member)  { offsetof(type, member), sizeof(((type*) 0)->member), 1 }
+// Describe a member of a struct whose bytes are sent as they're stored (e.g. a character array)
+#define BT_RECORD_BYTES(type, member)  { offsetof(type, member), sizeof(((type*) 0)->member), 0 }
+// Describe a record using an array of fields (e.g. BT_RECORD_SCHEMA(readingFields))
+#define BT_RECORD_SCHEMA(fieldArray)   { (fieldArray), sizeof(fieldArray) / sizeof((fieldArray)[0]) }
+
+/*
+ * ------------------------------------------------------
+ * These constants/types are used by the batch functions:
+ * ------------------------------------------------------
+ */
+
+// Define the structure used to collect samples for the batch functions (see bt_batchInit())
+typedef struct {
+    // The number of channels being sampled
+    uint8_t channels;
+    // The number of samples collected from each channel so far
+    uint8_t count;
+    // The samples collected from each channel
+    int16_t samples[BT_BATCH_MAX_CHANNELS][BT_BATCH_MAX_SAMPLES];
+} bt_batch;
+
 /*
  *    ___              __  _                         _    _            
  *   / __| ___  _ _   / _|(_) __ _  _  _  _ _  __ _ | |_ (_) ___  _ _  
@@ -87,13 +275,71 @@
  * take up to a second to exit.  Calls to bt_connected()
  * will return the correct value after this function exits.
  *
- * @returns 1 if the setup was completed successfully, 0 otherwise
+ * If BT_ENABLE_AUTO_BAUD_RATE is enabled, this function then
+ * finds the baud rate that the module is using (unless it's
+ * connected to a remote device), using bt_detectBaudRate().
+ *
+ * @returns 1 if the setup was completed successfully, 0 otherwise (e.g. if the module's baud rate couldn't be found)
  */
 uint8_t bt_setup();
 
 // Allow for the configuration function toggle
 #if BT_ENABLE_CONFIGURATION_FUNCTIONS
 
+    /**
+     * This function finds the baud rate that the Bluetooth module is
+     * using, and switches the UART stream to it.
+     * 
+     * Each baud rate supported by the module (that the library can
+     * use, see bt_setUARTBaudRate()) is tried, starting with the fastest,
+     * until the module responds to the "AT" command (see bt_test()).
+     * If the module doesn't respond at any of them, the UART stream
+     * goes back to the baud rate it was using before.
+     * 
+     * If BT_ENABLE_AUTO_BAUD_RATE is enabled, bt_setup() calls this
+     * function itself.  The baud rate found can be read later using
+     * bt_getUARTBaudRate().
+     * 
+     * This can take a second or two, and it doesn't work while the
+     * module is connected to a remote device.
+     * 
+     * @returns the baud rate found, or 0 if the module didn't respond
+     */
+    uint32_t bt_detectBaudRate();
+
+    /*
+    * --------------------------------------------------------------------------
+    * These functions keep a copy of the module's settings to avoid AT commands:
+    * --------------------------------------------------------------------------
+    */
+
+    // Allow for the configuration cache toggle
+    #if BT_ENABLE_CONFIGURATION_CACHE
+
+        /**
+         * This function reads all of the module's settings (name, PIN, MAC address,
+         * and authentication type) at once, and caches them so the bt_get* functions
+         * can answer without sending any AT commands.
+         * 
+         * Settings are also cached the first time they're read/written, so this
+         * isn't required, but it moves all of the waiting to one place (e.g. setup).
+         * 
+         * @returns 1 if every setting was read successfully, 0 otherwise
+         */
+        uint8_t bt_refreshConfiguration();
+
+    #endif
+
+    /**
+     * This function forgets the cached settings (except the MAC address, which can't
+     * change), so the next bt_get* call for each setting asks the module again.
+     * 
+     * This is done automatically by bt_reset() and bt_resetFactoryDefaults(), but
+     * should be done after changing settings using bt_sendATCommand() directly.
+     * If BT_ENABLE_CONFIGURATION_CACHE is disabled, this function does nothing.
+     */
+    void bt_invalidateConfiguration();
+
     /*
     * -------------------------------------------------------------------
     * These functions DO NOT need to be run each time the module is used:
@@ -121,7 +367,7 @@ uint8_t bt_setup();
      * it or not.
      * 
      * It uses the "AT+ADDR?" command to request the
-     * address.
+     * address (unless it's cached, see BT_ENABLE_CONFIGURATION_CACHE).
      * 
      * @param buffer the pre-allocated character buffer where the null-terminated address will be stored
      * @param bufferLength the length of the pre-allocated buffer provided to this function
@@ -129,7 +375,40 @@ uint8_t bt_setup();
      */
     size_t bt_getMACAddress(char* buffer, size_t bufferLength);
 
-    // TODO - AT+BAUD (?)
+    /**
+     * This function retrieves the baud rate that the Bluetooth
+     * module uses for its UART stream.
+     * 
+     * It uses the "AT+BAUD?" command to request the baud rate.
+     * 
+     * @param baudRate the pointer to the location where the baud rate (e.g. 9600) will be stored
+     * @returns 1 if the command ran successfully, 0 otherwise
+     */
+    uint8_t bt_getBaudRate(uint32_t* baudRate);
+
+    /**
+     * This function sets the baud rate that the Bluetooth module
+     * uses for its UART stream, restarts the module so the new baud
+     * rate takes effect, and then switches the library's UART stream
+     * to the new baud rate (see bt_setUARTBaudRate()).
+     * 
+     * The module keeps the new baud rate when it's powered off, so
+     * BT_BAUD_RATE should be updated to match it (or bt_setUARTBaudRate()
+     * should be called after bt_setup() each time the program starts).
+     * 
+     * The baud rates supported by the module are 1200, 2400, 4800,
+     * 9600, 19200, 38400, 57600, 115200, and 230400, but the software
+     * UART may not be fast enough for the higher ones (see
+     * bt_setUARTBaudRate()).  If the library can't use the baud rate,
+     * the module isn't changed.
+     * 
+     * It uses the "AT+BAUD" command to set the baud rate, and the
+     * "AT+RESET" command to restart the module.
+     * 
+     * @param baudRate the baud rate for the module
+     * @returns 1 if the commands ran successfully, 0 otherwise
+     */
+    uint8_t bt_setBaudRate(uint32_t baudRate);
 
     /**
      * This function retrieves the name of the Bluetooth module.
@@ -139,7 +418,8 @@ uint8_t bt_setup();
      * with a null-terminator regardless of if the response overflowed
      * it or not.
      * 
-     * It uses the "AT+NAME?" command to request the name.
+     * It uses the "AT+NAME?" command to request the name
+     * (unless it's cached, see BT_ENABLE_CONFIGURATION_CACHE).
      * 
      * @param buffer the pre-allocated character buffer where the null-terminated name will be stored
      * @param bufferLength the length of the pre-allocated buffer provided to this function
@@ -153,7 +433,8 @@ uint8_t bt_setup();
      * If a name is provided that is more than 12 characters,
      * only the first 12 characters will be used.
      * 
-     * It uses the "AT+NAME" command to set the name.
+     * It uses the "AT+NAME" command to set the name (unless
+     * the module is known to have the name already).
      * 
      * @param name the name for the module (max 12 characters)
      * @returns 1 if the command ran successfully, 0 otherwise
@@ -170,7 +451,8 @@ uint8_t bt_setup();
      * with a null-terminator regardless of if the response overflowed
      * it or not.
      * 
-     * It uses the "AT+PASS?" command to request the name.
+     * It uses the "AT+PASS?" command to request the PIN
+     * (unless it's cached, see BT_ENABLE_CONFIGURATION_CACHE).
      * 
      * Note: this function will not work if the device is not set
      * up to require some form of authentication.
@@ -303,6 +585,121 @@ uint8_t bt_setup();
      */
     size_t bt_sendATQuery(const char* command, const char* expectedResponsePrefix, char* responseBuffer, size_t responseBufferLength);
 
+    /*
+    * -------------------------------------------------------------------------
+    * These functions send configuration commands without blocking the program:
+    * -------------------------------------------------------------------------
+    */
+
+    /**
+     * This function starts sending a configuration command (AT command) to the
+     * Bluetooth module, and returns immediately.  The command is carried out
+     * each time bt_atPoll() is called (which should be done regularly until it
+     * no longer returns BT_AT_PENDING), so the program can do other work while
+     * waiting for the module to respond.
+     * 
+     * The command and expected response are not copied, so they must stay
+     * unchanged until the command completes.  Only one command can be in
+     * progress at a time.
+     * 
+     * @param command the command to send to the module
+     * @param expectedResponse the response expected to the command (e.g. "OK")
+     * @returns 1 if the command was started, 0 if another command is in progress or the module is connected to a remote device
+     */
+    uint8_t bt_atBegin(const char* command, const char* expectedResponse);
+
+    /**
+     * This function starts sending a configuration query (AT command) to the
+     * Bluetooth module, and returns immediately (see bt_atBegin()).
+     * 
+     * Once bt_atPoll() returns BT_AT_OK, the null-terminated response (without
+     * the prefix) is stored in the given buffer, truncated to fit if needed.
+     * The buffer must stay available until the query completes.
+     * 
+     * @param command the command to send to the module
+     * @param expectedResponsePrefix the prefix expected in the response to the command (e.g. "OK+Get:")
+     * @param responseBuffer the pre-allocated character buffer where the null-terminated response will be stored
+     * @param responseBufferLength the length of the pre-allocated buffer provided to this function
+     * @returns 1 if the query was started, 0 if another command is in progress or the module is connected to a remote device
+     */
+    uint8_t bt_atBeginQuery(const char* command, const char* expectedResponsePrefix, char* responseBuffer, size_t responseBufferLength);
+
+    /**
+     * This function carries out as much of the current command as it can
+     * without waiting, and reports its status.
+     * 
+     * After a successful command (other than a query), BT_AT_PENDING is
+     * returned for a short time afterwards (BT_AT_SET_WAIT_TIME_MS) to give
+     * the change time to take effect.  Once the command completes, its result is returned
+     * until the next command is started.
+     * 
+     * @returns BT_AT_PENDING, BT_AT_OK, or BT_AT_FAIL (or BT_AT_IDLE if no command has been started)
+     */
+    uint8_t bt_atPoll();
+
+    /**
+     * This function sets a function to be called (from within bt_atPoll())
+     * when a command started using bt_atBegin() or bt_atBeginQuery() completes.
+     * 
+     * @param callback the function to call, or NULL to stop calling a function
+     */
+    void bt_atSetCallback(bt_at_callback callback);
+
+    /*
+    * -----------------------------------------------------------------------------
+    * These functions change several settings with a single wait for them to apply:
+    * -----------------------------------------------------------------------------
+    */
+
+    /**
+     * This function starts collecting a set of settings to send to the Bluetooth
+     * module together using bt_configCommit() (any settings collected earlier that
+     * weren't committed are discarded).
+     * 
+     * Each of the bt_set* functions waits for its change to take effect before
+     * returning, so changing several settings in a row is slow.  Settings
+     * collected with the bt_configSet* functions are sent back-to-back, with a
+     * single wait at the end.
+     */
+    void bt_configBegin();
+
+    /**
+     * This function collects a new name for the Bluetooth module, to be sent
+     * by bt_configCommit() (see bt_setModuleName()).
+     * 
+     * @param name the new name for the module (up to 12 characters)
+     */
+    void bt_configSetModuleName(const char* name);
+
+    /**
+     * This function collects a new PIN for the Bluetooth module, to be sent
+     * by bt_configCommit() (see bt_setModulePIN()).
+     * 
+     * @param pin the new PIN for the module (up to 6 digits)
+     */
+    void bt_configSetModulePIN(const char* pin);
+
+    /**
+     * This function collects a new authentication type for the Bluetooth module,
+     * to be sent by bt_configCommit() (see bt_setAuthenticationType()).
+     * 
+     * @param type the authentication mode for the module
+     * @returns 1 if the type was collected, 0 if it isn't a valid type
+     */
+    uint8_t bt_configSetAuthenticationType(uint8_t type);
+
+    /**
+     * This function sends the settings collected since bt_configBegin() to the
+     * Bluetooth module, checking the response to each one, and then waits once
+     * for all of the changes to take effect.
+     * 
+     * If a setting fails, the remaining settings are not sent.  The collected
+     * settings are discarded either way.
+     * 
+     * @returns 1 if every setting was changed successfully, 0 otherwise
+     */
+    uint8_t bt_configCommit();
+
 #endif
 
 /*
@@ -333,6 +730,100 @@ uint8_t bt_setup();
  */
 uint8_t bt_connected();
 
+/**
+ * This function determines how many milliseconds have passed since
+ * bt_setup() was called, as counted by the UART interrupt (so no other
+ * timer is needed for timekeeping).  The count wraps around after about
+ * 49 days, so it should only be used to measure how much time has passed
+ * (e.g. bt_millis() - start >= timeout).
+ * 
+ * If BT_ENABLE_LOW_POWER_IDLE is enabled, the count stops while the UART
+ * timer is stopped.  Calling this function starts the timer again for a
+ * few milliseconds, so loops that check it for a timeout work as usual.
+ * 
+ * @return uint32_t the number of milliseconds counted so far
+ */
+uint32_t bt_millis();
+
+// Allow for the software timer toggle
+#if BT_ENABLE_SOFTWARE_TIMERS
+
+    /**
+     * This function schedules a function to be called after a delay (and
+     * then repeatedly, if a period is given).  The delay is counted by the
+     * UART interrupt's millisecond tick, so the first call happens up to a
+     * millisecond early.
+     * 
+     * The function is called from within the UART interrupt service routine
+     * (or from bt_processEvents(), if BT_ENABLE_DEFERRED_EVENTS is enabled),
+     * so it should be designed accordingly.
+     * 
+     * @param callback the function to call
+     * @param delayMs the number of milliseconds until the first call (at least 1)
+     * @param periodMs the number of milliseconds between later calls, or 0 to only call the function once
+     * @return uint8_t the ID of the timer (for bt_cancelTimer()), or BT_TIMER_NONE if BT_SOFTWARE_TIMER_COUNT timers are already scheduled
+     */
+    uint8_t bt_startTimer(bt_timer_callback callback, const uint16_t delayMs, const uint16_t periodMs);
+
+    /**
+     * This function cancels a timer scheduled using bt_startTimer() (any
+     * calls that haven't happened yet are dropped).
+     * 
+     * @param timer the ID of the timer to cancel
+     */
+    void bt_cancelTimer(const uint8_t timer);
+
+#endif
+
+// Allow for the deferred event toggle
+#if BT_ENABLE_DEFERRED_EVENTS
+
+    /**
+     * This function runs the connection/disconnection handlers for any
+     * connection changes that have been queued by the UART interrupt
+     * (oldest first).
+     * 
+     * It should be called regularly (e.g. from the program's main loop),
+     * since connection changes are dropped once BT_EVENT_QUEUE_LENGTH of
+     * them are waiting.
+     * 
+     * @return uint8_t the number of events processed
+     */
+    uint8_t bt_processEvents();
+
+#endif
+
+/**
+ * This function switches the UART stream to a different baud rate.
+ * It only changes the library's side of the stream, so it should be
+ * used when the Bluetooth module's baud rate is already set (e.g. by
+ * bt_setBaudRate(), which calls this function itself).
+ * 
+ * Bytes that have been written but not sent yet are sent at the old
+ * baud rate before switching, and any byte being received while the
+ * baud rate changes may be lost.
+ * 
+ * The baud rate can only be used if the timer (or the USART, if
+ * BT_ENABLE_HARDWARE_UART is enabled) can produce it closely enough.
+ * The software UART's timer also interrupts the program at 3x the
+ * baud rate, so at higher baud rates it may not have enough time to
+ * finish each tick (at 16MHz, baud rates above 19200 generally require
+ * the hardware USART; see bt_getISRProfile()).
+ * 
+ * @param baudRate the baud rate to use
+ * @returns 1 if the baud rate was changed, 0 if it can't be used
+ */
+uint8_t bt_setUARTBaudRate(const uint32_t baudRate);
+
+/**
+ * This function retrieves the baud rate currently used by the
+ * UART stream (BT_BAUD_RATE, unless it has been changed using
+ * bt_setUARTBaudRate()).
+ * 
+ * @returns the baud rate in use
+ */
+uint32_t bt_getUARTBaudRate();
+
 /**
  * This function checks to see if a byte of data is available
  * to be read from the Bluetooth module's UART stream.
@@ -376,10 +867,91 @@ uint8_t bt_awaitAvailable();
  * This function writes a byte of data to the Bluetooth module's
  * UART stream.
  * 
+ * The byte is queued in the output buffer and sent in the background
+ * by the UART interrupt, so this function only blocks if the output
+ * buffer is full (see BT_UART_TX_BUFFER_LENGTH).  For non-blocking
+ * functionality, use bt_tryWrite().
+ * 
  * @param byte the byte of data to write
  */
 void bt_write(const uint8_t byte);
 
+/**
+ * This function attempts to queue a byte of data to be written to the
+ * Bluetooth module's UART stream.
+ * 
+ * This function does not block, so if the output buffer is full, the
+ * byte is not queued and 0 is returned.
+ * 
+ * @param byte the byte of data to write
+ * @returns 1 if the byte was queued, 0 if the output buffer is full
+ */
+uint8_t bt_tryWrite(const uint8_t byte);
+
+/**
+ * This function determines how many bytes have been written to
+ * the UART stream but have not finished being sent yet (including
+ * the byte currently being sent, if there is one).
+ * 
+ * @returns the number of bytes that have not been sent yet
+ */
+size_t bt_txPending();
+
+/**
+ * This function blocks until all bytes written to the UART stream
+ * have been sent completely.
+ */
+void bt_drain();
+
+/**
+ * This function writes a block of bytes to the Bluetooth module's
+ * UART stream without copying them into the output buffer.
+ * 
+ * The bytes are sent in the background by the UART interrupt directly
+ * from the provided memory, so it must not be changed until
+ * bt_writeComplete() returns 1.  Bytes written after this function
+ * returns are sent after this block.
+ * 
+ * Only one block (or bt_writev() call) can be in progress at a time, so
+ * this function blocks until the previous one has been handed off to the
+ * transmitter completely.
+ * 
+ * @param data the bytes to write
+ * @param length the number of bytes to write
+ */
+void bt_writeBuffer(const uint8_t* data, size_t length);
+
+/**
+ * This function writes several regions of memory to the Bluetooth
+ * module's UART stream, one after another, without copying them into
+ * the output buffer (e.g. to send a header, payload, and checksum
+ * without assembling them into one buffer first).
+ * 
+ * The region descriptions are copied, but the bytes are sent in the
+ * background directly from the regions themselves, so they must not
+ * be changed until bt_writeComplete() returns 1.  Bytes written after
+ * this function returns are sent after these regions.
+ * 
+ * Only one bt_writev() call (or block from bt_writeBuffer()) can be in
+ * progress at a time, so this function blocks until the previous one has
+ * been handed off to the transmitter completely.  If more than
+ * BT_UART_TX_MAX_SEGMENTS regions are provided, it also blocks until the
+ * earlier regions have been handed off.
+ * 
+ * @param segments the regions to write
+ * @param segmentCount the number of regions to write
+ */
+void bt_writev(const bt_iovec* segments, size_t segmentCount);
+
+/**
+ * This function determines if the transmitter is done with the memory
+ * provided to the last bt_writeBuffer() or bt_writev() call, so that
+ * it can be changed or reused.
+ * 
+ * @returns 1 if the memory can be reused, 0 if it is still being sent
+ */
+uint8_t bt_writeComplete();
+
 /**
  * This function reads a byte of data from the Bluetooth module's
  * UART stream.
@@ -392,12 +964,144 @@ void bt_write(const uint8_t byte);
  */
 uint8_t bt_read();
 
+/**
+ * This function determines how many bytes of data have been
+ * received from the Bluetooth module's UART stream but have
+ * not been read yet.
+ * 
+ * @returns the number of bytes available
+ */
+size_t bt_availableBytes();
+
+/**
+ * This function reads a byte of data from the Bluetooth module's
+ * UART stream without removing it from the input buffer.
+ * 
+ * This function does not block, and will return 0 if there are not
+ * enough bytes available.  To ensure the byte is available, verify
+ * bt_availableBytes() first.
+ * 
+ * @param offset the position of the byte to read (0 is the next byte bt_read() would return)
+ * @returns the byte of data read
+ */
+uint8_t bt_peek(const size_t offset);
+
+/**
+ * This function finds the largest block of available bytes that
+ * are stored next to each other in the input buffer, so they can
+ * be processed in place instead of being read one at a time.
+ * 
+ * The bytes in the block stay in place (and stay unchanged) until they
+ * are removed using bt_consume() or bt_flush().  If the length is less
+ * than bt_availableBytes(), the rest of the bytes have wrapped around to
+ * the start of the input buffer, and can be found by calling this
+ * function again after consuming this block.
+ * 
+ * @param data the pointer to the location where the start of the block will be stored
+ * @param length the pointer to the location where the number of bytes in the block will be stored
+ */
+void bt_rxSpan(const uint8_t** data, size_t* length);
+
+/**
+ * This function removes bytes from the input buffer without reading
+ * them (e.g. after processing them using bt_peek() or bt_rxSpan()).
+ * 
+ * @param count the number of bytes to remove (limited to the number of bytes available)
+ */
+void bt_consume(const size_t count);
+
 /**
  * This function resets the input buffers and removes any
  * unprocessed input.
  */
 void bt_flush();
 
+// Allow for the line mode toggle
+#if BT_ENABLE_LINE_MODE
+
+    /**
+     * This function determines how many complete lines (ending with
+     * BT_LINE_DELIMITER) are waiting in the input buffer.
+     * 
+     * The UART interrupt counts delimiters as they arrive, so this
+     * function doesn't need to look through the input buffer.
+     * 
+     * @returns the number of complete lines waiting
+     */
+    size_t bt_linesAvailable();
+
+    /**
+     * This function reads a complete line (ending with BT_LINE_DELIMITER)
+     * from the UART stream.
+     * 
+     * This function is non-blocking, so if a complete line hasn't been
+     * received yet, it returns immediately without reading anything.
+     * The delimiter is removed from the input, but it isn't stored in
+     * the buffer.  If a line is too long to fit in the input buffer
+     * (BT_UART_RX_BUFFER_LENGTH), the part that fits is returned as a line.
+     * 
+     * If the line overflows the provided buffer, the line will be
+     * truncated to fill the buffer (the rest of the line is discarded),
+     * and the buffer will end with a null-terminator regardless of if
+     * the line overflowed it or not.
+     * 
+     * If bufferLength is 0, the line is removed from the input
+     * without storing anything.
+     * 
+     * @param buffer the pre-allocated character buffer where the null-terminated line will be stored
+     * @param bufferLength the length of the pre-allocated buffer provided to this function
+     * @returns the length of the line returned (excluding the null-terminator), or BT_LINE_NONE if a complete line isn't available
+     */
+    size_t bt_readLine(char* buffer, size_t bufferLength);
+
+#endif
+
+// Allow for the statistics toggle
+#if BT_ENABLE_STATISTICS
+
+    /**
+     * This function reports the UART statistics counted since the library
+     * was set up (or since bt_resetStats() was called).
+     * 
+     * The counters are copied with interrupts disabled, so they are all
+     * from the same moment.
+     * 
+     * @param stats the pointer to the location where the statistics will be stored
+     */
+    void bt_getStats(bt_stats* stats);
+
+    /**
+     * This function clears the statistics reported by bt_getStats().
+     */
+    void bt_resetStats();
+
+#endif
+
+// Allow for the ISR profiling toggle
+#if BT_ENABLE_ISR_PROFILING
+
+    /**
+     * This function reports how long each path through the UART timer ISR
+     * has taken since the library was set up (or since bt_resetISRProfile()
+     * was called).
+     * 
+     * Each pass is timed from the timer's compare match to the end of the ISR
+     * (so the time taken to enter the ISR is included, but the time taken to
+     * return from it is not), with the precision of the timer's prescaler.  If
+     * any path's worst case is longer than budgetCycles, the UART can't keep
+     * up at the configured baud rate.
+     * 
+     * @param profile the pointer to the location where the measurements will be stored
+     */
+    void bt_getISRProfile(bt_isr_profile* profile);
+
+    /**
+     * This function clears the measurements reported by bt_getISRProfile().
+     */
+    void bt_resetISRProfile();
+
+#endif
+
 /*
  *   ___    __ ___      _   _  _    _  _  _  _    _          
  *  |_ _|  / // _ \    | | | || |_ (_)| |(_)| |_ (_) ___  ___
@@ -451,6 +1155,73 @@ void bt_flush();
      */
     size_t bt_readString(const char delimiter, char* buffer, size_t bufferLength);
 
+    // Allow for the compression function toggle
+    #if BT_ENABLE_COMPRESSION_FUNCTIONS
+
+        /**
+         * This function starts a compressed stream (see bt_compressWrite()).
+         */
+        void bt_compressBegin();
+
+        /**
+         * This function compresses bytes and sends them to the UART stream
+         * (after bt_compressBegin()).  It can be called as many times as needed,
+         * and repeats are found across calls.
+         * 
+         * The stream is compressed using LZSS: each run of 2-17 bytes that also
+         * appeared in the last 2^BT_COMPRESSION_WINDOW_BITS bytes is sent
+         * as a reference back to it (12 bits by default), and every other byte
+         * is sent as it is (9 bits).  The compressed bytes are collected into
+         * blocks of BT_COMPRESSION_BLOCK_LENGTH and sent using bt_writeBuffer().
+         * 
+         * The last few bytes are held back (to find longer repeats) until more
+         * bytes are written or bt_compressEnd() is called.
+         * 
+         * @param data the bytes to compress
+         * @param length the number of bytes to compress
+         */
+        void bt_compressWrite(const uint8_t* data, size_t length);
+
+        /**
+         * This function sends the rest of a compressed stream, along with a
+         * marker so the remote device knows where the stream ends.  This
+         * function blocks until the transmitter is done with the stream.
+         * 
+         * @returns the size of the compressed stream as a percentage of the bytes written (e.g. 40 means 60% fewer bytes were sent), or 0 if nothing was written
+         */
+        uint16_t bt_compressEnd();
+
+        /**
+         * This function prepares to read a compressed stream (see
+         * bt_decompressRead()).
+         */
+        void bt_decompressBegin();
+
+        /**
+         * This function reads a stream sent using bt_compressWrite() from the
+         * UART stream, decompressing it into the buffer provided.
+         * 
+         * This function returns once the buffer is full, the end of the stream
+         * has been reached, or no more bytes have arrived (like
+         * bt_awaitAvailable()).  Keep calling it until bt_decompressComplete()
+         * returns 1 to read the whole stream.
+         * 
+         * @param buffer the pre-allocated buffer where the decompressed bytes will be stored
+         * @param bufferLength the length of the pre-allocated buffer provided to this function
+         * @returns the number of bytes decompressed into the buffer
+         */
+        size_t bt_decompressRead(uint8_t* buffer, size_t bufferLength);
+
+        /**
+         * This function checks if the whole compressed stream has been
+         * read by bt_decompressRead().
+         * 
+         * @returns 1 if the end of the stream has been reached, 0 otherwise
+         */
+        uint8_t bt_decompressComplete();
+
+    #endif
+
     /*
     * -----------------------------------------------------------
     * Utility functions for sending integers via the UART stream:
@@ -545,6 +1316,219 @@ void bt_flush();
      */
     uint16_t bt_readUInt16();
 
+    /**
+     * This function writes an unsigned 32-bit integer value to the UART
+     * stream as a variable-length integer (LEB128), so smaller values
+     * take fewer bytes:
+     *  - 0 to 127 takes 1 byte
+     *  - 128 to 16,383 takes 2 bytes
+     *  - 16,384 to 2,097,151 takes 3 bytes
+     *  - up to 5 bytes for larger values
+     * 
+     * Each byte holds 7 bits of the value (least significant bits first),
+     * and the top bit of each byte is set if more bytes follow.  The bytes
+     * are always sent in this order (BT_UART_ENDIANNESS is not used).
+     * 
+     * 16-bit values can be sent using this function as well, since they
+     * take the same number of bytes.
+     * 
+     * @param value the value to send
+     */
+    void bt_writeVarUInt32(uint32_t value);
+
+    /**
+     * This function reads an unsigned variable-length integer value sent
+     * using bt_writeVarUInt32() from the UART stream.
+     * 
+     * If an error occurs while reading, 0 is returned.
+     * 
+     * @returns the value read
+     */
+    uint32_t bt_readVarUInt32();
+
+    /**
+     * This function writes a signed 32-bit integer value to the UART
+     * stream as a variable-length integer (see bt_writeVarUInt32()).
+     * 
+     * The value is zigzag-encoded first (0, -1, 1, -2, 2, ... are sent as
+     * 0, 1, 2, 3, 4, ...), so values close to 0 take fewer bytes whether
+     * they're positive or negative (-64 to 63 takes 1 byte).
+     * 
+     * @param value the value to send
+     */
+    void bt_writeVarInt32(int32_t value);
+
+    /**
+     * This function reads a signed variable-length integer value sent
+     * using bt_writeVarInt32() from the UART stream.
+     * 
+     * If an error occurs while reading, 0 is returned.
+     * 
+     * @returns the value read
+     */
+    int32_t bt_readVarInt32();
+
+    /*
+    * ----------------------------------------------------------
+    * Utility functions for sending records via the UART stream:
+    * ----------------------------------------------------------
+    */
+
+    /**
+     * This function writes a struct to the UART stream, using a schema
+     * to describe which members are sent (and in which order).  For example:
+     * 
+     *     typedef struct { uint32_t time; int16_t temperature; char unit[2]; } reading;
+     *     static const bt_record_field readingFields[] = {
+     *         BT_RECORD_FIELD(reading, time),
+     *         BT_RECORD_FIELD(reading, temperature),
+     *         BT_RECORD_BYTES(reading, unit)
+     *     };
+     *     static const bt_record_schema readingSchema = BT_RECORD_SCHEMA(readingFields);
+     * 
+     *     bt_writeRecord(&readingSchema, &current);
+     * 
+     * Integer fields are sent in the order defined by BT_UART_ENDIANNESS
+     * (the same as bt_writeInt32(), etc.), so the record above is sent
+     * exactly as bt_writeUInt32() followed by bt_writeInt16() and two
+     * bt_write() calls would send it.
+     * 
+     * The fields are packed in a single pass and sent as one block (see
+     * bt_writeBuffer()), and this function blocks until the transmitter is
+     * done with them, so the struct can be changed as soon as it returns.
+     * 
+     * @param schema the schema describing the struct
+     * @param record the struct to send
+     * @returns 1 if the record was sent, 0 if it's longer than BT_RECORD_MAX_LENGTH (and nothing was sent)
+     */
+    uint8_t bt_writeRecord(const bt_record_schema* schema, const void* record);
+
+    /**
+     * This function reads a struct sent using bt_writeRecord() (with
+     * the same schema) from the UART stream.
+     * 
+     * Each byte is read straight into its place in the struct.
+     * If an error occurs while reading, the fields that weren't
+     * received are filled with zeros.
+     * 
+     * @param schema the schema describing the struct
+     * @param record the struct to read into
+     * @returns 1 if the whole record was read, 0 otherwise
+     */
+    uint8_t bt_readRecord(const bt_record_schema* schema, void* record);
+
+#endif
+
+// Allow for the batch function toggle
+#if BT_ENABLE_BATCH_FUNCTIONS
+
+    /**
+     * This function prepares a batch to collect samples (see bt_batchAdd()).
+     * 
+     * @param batch the batch to prepare
+     * @param channels the number of values in each sample (up to BT_BATCH_MAX_CHANNELS)
+     */
+    void bt_batchInit(bt_batch* batch, const uint8_t channels);
+
+    /**
+     * This function adds a sample (one value for each channel) to a batch.
+     * Once BT_BATCH_MAX_SAMPLES samples have been collected, the batch
+     * is sent (see bt_sendBatch()) and a new one is started.
+     * 
+     * @param batch the batch to add the sample to
+     * @param values the value of each channel
+     * @returns 1 if the batch was sent, 0 otherwise
+     */
+    uint8_t bt_batchAdd(bt_batch* batch, const int16_t* values);
+
+    /**
+     * This function sends the samples collected by a batch (even if it
+     * isn't full yet) to the UART stream, and starts a new one.
+     * 
+     * The batch is sent as the number of samples and channels (1 byte each),
+     * followed by each channel in turn:
+     *  - the first sample (see bt_writeInt16())
+     *  - the number of bits used for each difference (1 byte)
+     *  - the differences between samples, zigzag-encoded (see bt_writeVarInt32())
+     *    and packed together (most significant bit first), padded to a whole byte
+     * 
+     * For example, 16 samples that change by no more than +/-3 each take
+     * 9 bytes per channel instead of 32 (2 for the first sample, 1 for
+     * the width, and 15 differences of 3 bits each packed into 6).
+     * 
+     * @param batch the batch to send
+     */
+    void bt_sendBatch(bt_batch* batch);
+
+    /**
+     * This function reads a batch sent using bt_sendBatch() from the
+     * UART stream.
+     * 
+     * If an error occurs while reading (or the batch has more samples or
+     * channels than BT_BATCH_MAX_SAMPLES/BT_BATCH_MAX_CHANNELS allow),
+     * 0 is returned and the batch is left empty.
+     * 
+     * @param batch the batch to read the samples into
+     * @returns the number of samples read from each channel
+     */
+    uint8_t bt_receiveBatch(bt_batch* batch);
+
+#endif
+
+// Allow for the frame function toggle
+#if BT_ENABLE_FRAME_FUNCTIONS
+
+    /**
+     * This function sends a block of bytes to the UART stream as a frame,
+     * so the receiver can tell exactly where it ends and whether it
+     * arrived intact (see bt_receiveFrame()).
+     * 
+     * Each frame is made up of a delimiter byte (0x7E), a
+     * length byte, the bytes themselves, and a CRC-16 (CCITT) of the length
+     * and the bytes (most significant byte first).
+     * 
+     * The bytes are sent without being copied into the output buffer (see
+     * bt_writeBuffer()), and this function blocks until the transmitter is
+     * done with them, so they can be changed as soon as it returns.
+     * 
+     * @param data the bytes to send
+     * @param length the number of bytes to send (max BT_FRAME_MAX_LENGTH)
+     * @returns 1 if the frame was sent, 0 if it's too long
+     */
+    uint8_t bt_sendFrame(const uint8_t* data, const uint8_t length);
+
+    /**
+     * This function reads a frame sent using bt_sendFrame() from the
+     * UART stream.
+     * 
+     * This function is non-blocking, so it processes the bytes that
+     * have been received so far and returns.  A frame is returned as soon
+     * as its last byte arrives (without waiting for BT_UART_PACKET_WAIT_MS
+     * like bt_awaitAvailable()).  Frames that don't arrive intact are
+     * dropped, and anything received outside of a frame is ignored.
+     * 
+     * If the frame overflows the provided buffer, the frame will be
+     * truncated to fill the buffer.
+     * 
+     * @param buffer the pre-allocated buffer where the frame will be stored
+     * @param bufferLength the length of the pre-allocated buffer provided to this function
+     * @param length the pointer to the location where the length of the frame returned will be stored
+     * @returns BT_FRAME_OK if a frame was received, BT_FRAME_CORRUPT if one was dropped, or BT_FRAME_PENDING otherwise
+     */
+    uint8_t bt_receiveFrame(uint8_t* buffer, size_t bufferLength, size_t* length);
+
+    /**
+     * This function waits for a frame to be received from the UART
+     * stream (see bt_receiveFrame()).
+     * 
+     * @param buffer the pre-allocated buffer where the frame will be stored
+     * @param bufferLength the length of the pre-allocated buffer provided to this function
+     * @param length the pointer to the location where the length of the frame returned will be stored
+     * @param timeoutMs the number of milliseconds to wait before giving up
+     * @returns BT_FRAME_OK if a frame was received, BT_FRAME_CORRUPT if one was dropped, or BT_FRAME_PENDING if the timeout was exceeded
+     */
+    uint8_t bt_awaitFrame(uint8_t* buffer, size_t bufferLength, size_t* length, const uint16_t timeoutMs);
+
 #endif
 
 #endif // BLUETOOTH_H
@@ -0,0 +1,447 @@
+/*
+ * This file contains the implementation of the host simulation backend
+ * for the Bluetooth library (see bluetooth_host.h).
+ *
+ * The simulation is event-driven: time jumps straight to the next event
+ * (a timer compare match, a change on the RX or State line, or a point
+ * where the TX line is sampled) instead of stepping one cycle at a time.
+ * Interrupt service routines run instantly when their event happens.
+ */
+
+#include "bluetooth_settings.h"
+
+// Allow for the host simulation toggle (this file is empty when building for an AVR)
+#if BT_HOST_SIMULATION
+
+#include <string.h>
+
+#include "bluetooth_host.h"
+#include "bluetooth_internal.h"
+
+/*
+ * ----------------------------------------------------------
+ * Virtual registers (initialized to their AVR reset values):
+ * ----------------------------------------------------------
+ */
+
+volatile uint8_t SREG = 0;
+// The RX line idles high
+volatile uint8_t PIND = (1 << BT_RX_BIT), DDRD = 0, PORTD = 0;
+volatile uint8_t TCCR0A = 0, TCCR0B = 0, TCNT0 = 0, OCR0A = 0, TIMSK0 = 0, TIFR0 = 0;
+volatile uint8_t EICRA = 0, EIMSK = 0, EIFR = 0;
+volatile uint8_t PCICR = 0, PCMSK2 = 0;
+
+// Declare the library's interrupt service routines
+void BT_TIMER_INTERRUPT_VECTOR(void);
+#if BT_ENABLE_EDGE_TRIGGERED_RX
+    void BT_RX_INTERRUPT_VECTOR(void);
+#endif
+#if BT_ENABLE_LOW_POWER_IDLE
+    void BT_STATE_INTERRUPT_VECTOR(void);
+#endif
+
+/*
+ * -------------------
+ * Simulation globals:
+ * -------------------
+ */
+
+// Number of cycles simulated so far
+static uint64_t hostCycles = 0;
+// Number of cycles counted towards the next timer clock (the timer counts once every [prescaler] cycles)
+static uint32_t hostTimerFraction = 0;
+// 1 if the timer has reached its compare value and the ISR hasn't run yet
+static uint8_t  hostTimerPending = 0;
+// 1 if the RX interrupt has seen an edge and the ISR hasn't run yet
+static uint8_t  hostRxEdgePending = 0;
+// 1 if the State pin has changed (with its pin change interrupt enabled) and the ISR hasn't run yet
+#if BT_ENABLE_LOW_POWER_IDLE
+    static uint8_t hostStateChangePending = 0;
+#endif
+// Number of ISRs run so far (and how many of them were the timer's), and the number of cycles spent sleeping
+static uint32_t hostInterruptCount = 0, hostTimerInterruptCount = 0;
+static uint64_t hostSleepCycles = 0;
+
+// Baud rate used by the simulated Bluetooth module for both lines
+static uint32_t hostLineBaudRate = BT_BAUD_RATE;
+
+// Bytes waiting to be sent on the RX line
+static uint8_t  hostRxQueue[BT_HOST_QUEUE_LENGTH];
+static size_t   hostRxQueueHead = 0, hostRxQueueCount = 0;
+// The byte being sent on the RX line, the current bit (-1 if idle), and when the byte/next bit starts
+static uint8_t  hostRxByte;
+static int8_t   hostRxBit = -1;
+static uint64_t hostRxByteStart, hostRxNextChange;
+
+// Bytes decoded from the TX line
+static uint8_t  hostTxQueue[BT_HOST_QUEUE_LENGTH];
+static size_t   hostTxQueueHead = 0, hostTxQueueCount = 0;
+// The last level seen on the TX line (it idles high)
+static uint8_t  hostTxLevel = 1;
+// The byte being decoded from the TX line, the next bit to sample (-1 if idle), and when to sample it
+static uint8_t  hostTxByte;
+static int8_t   hostTxBit = -1;
+static uint64_t hostTxByteStart, hostTxNextSample;
+static uint32_t hostTxFramingErrorCount = 0;
+static void   (*hostTxHandler)(uint8_t byte) = NULL;
+
+// 1 if the State line shows a connection, and when it toggles next while disconnected
+static uint8_t  hostConnected = 0;
+static uint64_t hostStateNextToggle = 0;
+
+/*
+ * ------------------------------
+ * Internal simulation functions:
+ * ------------------------------
+ */
+
+// This function finds the number of cycles from the start of a byte to the start of one of its bits
+static uint64_t bt_hostBitOffset(const uint32_t halfBits) {
+    // (measured in half bits, so the middle of a bit can be found without rounding drift)
+    return ((uint64_t) halfBits * F_CPU) / ((uint64_t) hostLineBaudRate * 2);
+}
+
+// This function finds the number of cycles per timer clock for the current prescaler (0 if the timer is stopped)
+static uint32_t bt_hostTimerPrescale() {
+    switch (BT_TIMER_CONTROL_REGISTER_B & 0x07) {
+        case 1: return 1;
+        case 2: return 8;
+        case 3: return 64;
+        case 4: return 256;
+        case 5: return 1024;
+        default: return 0;
+    }
+}
+
+// This function finds the number of timer clocks until the timer next reaches its compare value
+static uint32_t bt_hostTimerClocksUntilCompare() {
+    uint32_t counter = BT_TIMER_COUNTER_REGISTER;
+    uint32_t top = BT_TIMER_COMPARE_REGISTER;
+
+    // If the counter was set past the compare value, it has to wrap around first
+    if (counter <= top)
+        return top - counter + 1;
+    return (BT_TIMER_MAXIMUM_VALUE - counter + 1) + top + 1;
+}
+
+// This function finds the number of cycles until the timer next reaches its compare value
+static uint64_t bt_hostCyclesUntilCompare() {
+    uint32_t prescale = bt_hostTimerPrescale();
+    if (prescale == 0)
+        return UINT64_MAX;
+
+    // Keep the partial clock in range if the prescaler was lowered
+    hostTimerFraction %= prescale;
+    return (uint64_t) bt_hostTimerClocksUntilCompare() * prescale - hostTimerFraction;
+}
+
+// This function runs the timer for the given number of cycles
+static void bt_hostAdvanceTimer(const uint64_t cycles) {
+    uint32_t prescale = bt_hostTimerPrescale();
+    if (prescale == 0)
+        return;
+
+    // Find the number of timer clocks that have passed
+    uint64_t total = hostTimerFraction % prescale + cycles;
+    uint64_t clocks = total / prescale;
+    hostTimerFraction = (uint32_t) (total % prescale);
+
+    while (clocks > 0) {
+        uint32_t untilCompare = bt_hostTimerClocksUntilCompare();
+        if (clocks >= untilCompare) {
+            // Clear the timer on the compare match (CTC mode), and request the interrupt
+            clocks -= untilCompare;
+            BT_TIMER_COUNTER_REGISTER = 0;
+            hostTimerPending = 1;
+            BT_TIMER_INTERRUPT_FLAG_REGISTER |= BT_TIMER_INTERRUPT_FLAG_MASK;
+        } else {
+            BT_TIMER_COUNTER_REGISTER = (uint8_t) ((BT_TIMER_COUNTER_REGISTER + clocks) % (BT_TIMER_MAXIMUM_VALUE + 1));
+            clocks = 0;
+        }
+    }
+}
+
+// This function changes the level of the RX line (and triggers the RX interrupt on falling edges)
+static void bt_hostDriveRx(const uint8_t level) {
+    uint8_t previous = (BT_RX_PIN & (1 << BT_RX_BIT)) != 0;
+
+    if (level)
+        BT_RX_PIN |= (1 << BT_RX_BIT);
+    else
+        BT_RX_PIN &= ~(1 << BT_RX_BIT);
+
+    if (previous && !level)
+        hostRxEdgePending = 1;
+}
+
+// This function changes the level of the State line (and triggers the pin change interrupt if it's enabled)
+static void bt_hostDriveState(const uint8_t level) {
+    #if BT_ENABLE_LOW_POWER_IDLE
+        uint8_t previous = (BT_STATE_PIN & (1 << BT_STATE_BIT)) != 0;
+        if (previous != level && (BT_STATE_INTERRUPT_MASK_REGISTER & BT_STATE_INTERRUPT_ENABLE_MASK))
+            hostStateChangePending = 1;
+    #endif
+
+    if (level)
+        BT_STATE_PIN |= (1 << BT_STATE_BIT);
+    else
+        BT_STATE_PIN &= ~(1 << BT_STATE_BIT);
+}
+
+// This function sends the queued bytes on the RX line (one bit at a time as they come due)
+static void bt_hostUpdateRx() {
+    while (1) {
+        if (hostRxBit < 0) {
+            // If the line is idle and a byte is queued, start sending it with a start bit
+            if (hostRxQueueCount == 0)
+                return;
+            hostRxByte = hostRxQueue[hostRxQueueHead];
+            hostRxQueueHead = (hostRxQueueHead + 1) % BT_HOST_QUEUE_LENGTH;
+            hostRxQueueCount--;
+
+            hostRxByteStart = hostCycles;
+            hostRxBit = 0;
+            bt_hostDriveRx(0);
+        } else if (hostCycles >= hostRxNextChange) {
+            // Send the data bits (least significant bit first), then the stop bit
+            hostRxBit++;
+            if (hostRxBit <= 8) {
+                bt_hostDriveRx((hostRxByte >> (hostRxBit - 1)) & 0x01);
+            } else if (hostRxBit == 9) {
+                bt_hostDriveRx(1);
+            } else {
+                // The stop bit is done, so the line is ready for the next byte
+                hostRxBit = -1;
+                continue;
+            }
+        } else {
+            return;
+        }
+        hostRxNextChange = hostRxByteStart + bt_hostBitOffset((hostRxBit + 1) * 2);
+    }
+}
+
+// This function decodes the bytes sent on the TX line
+static void bt_hostUpdateTx() {
+    uint8_t level = (BT_TX_PORT & (1 << BT_TX_BIT)) != 0;
+
+    // A falling edge on an idle line is the start of a byte (sample each bit in its middle)
+    if (hostTxBit < 0 && hostTxLevel && !level) {
+        hostTxByteStart = hostCycles;
+        hostTxByte = 0;
+        hostTxBit = 1;
+        hostTxNextSample = hostTxByteStart + bt_hostBitOffset(3);
+    }
+    hostTxLevel = level;
+
+    while (hostTxBit >= 0 && hostCycles >= hostTxNextSample) {
+        if (hostTxBit <= 8) {
+            hostTxByte |= level << (hostTxBit - 1);
+            hostTxBit++;
+            hostTxNextSample = hostTxByteStart + bt_hostBitOffset(hostTxBit * 2 + 1);
+        } else {
+            // The stop bit must be high
+            if (!level)
+                hostTxFramingErrorCount++;
+            hostTxBit = -1;
+
+            // Hand the byte to the handler, or store it (if the queue is full, the byte is dropped)
+            if (hostTxHandler) {
+                hostTxHandler(hostTxByte);
+            } else if (hostTxQueueCount < BT_HOST_QUEUE_LENGTH) {
+                hostTxQueue[(hostTxQueueHead + hostTxQueueCount) % BT_HOST_QUEUE_LENGTH] = hostTxByte;
+                hostTxQueueCount++;
+            }
+        }
+    }
+}
+
+// This function toggles the State line while disconnected (like the module's status LED)
+static void bt_hostUpdateState() {
+    if (hostConnected) {
+        bt_hostDriveState(1);
+    } else if (hostCycles >= hostStateNextToggle) {
+        bt_hostDriveState(!(BT_STATE_PIN & (1 << BT_STATE_BIT)));
+        hostStateNextToggle = hostCycles + F_CPU / 2;
+    }
+}
+
+// This function runs an ISR the way an AVR does (with interrupts disabled until it returns)
+static void bt_hostRunISR(void (*isr)(void)) {
+    SREG &= ~0x80;
+    isr();
+    SREG |= 0x80;
+    hostInterruptCount++;
+}
+
+// This function runs the ISRs for any interrupts that are enabled and pending
+static void bt_hostDispatchInterrupts() {
+    #if BT_ENABLE_EDGE_TRIGGERED_RX
+        // Interrupt flags are cleared by writing 1 to them, which the virtual registers
+        // can't detect on their own, so treat any flag that's set as a request to clear it
+        if (BT_RX_INTERRUPT_FLAG_REGISTER & BT_RX_INTERRUPT_FLAG_MASK) {
+            hostRxEdgePending = 0;
+            BT_RX_INTERRUPT_FLAG_REGISTER &= ~BT_RX_INTERRUPT_FLAG_MASK;
+        }
+    #endif
+
+    while (SREG & 0x80) {
+        #if BT_ENABLE_EDGE_TRIGGERED_RX
+            // The external interrupt has priority over the timer (like on an AVR)
+            if (hostRxEdgePending && (BT_RX_INTERRUPT_MASK_REGISTER & BT_RX_INTERRUPT_ENABLE_MASK)) {
+                hostRxEdgePending = 0;
+                bt_hostRunISR(BT_RX_INTERRUPT_VECTOR);
+                if (BT_RX_INTERRUPT_FLAG_REGISTER & BT_RX_INTERRUPT_FLAG_MASK) {
+                    hostRxEdgePending = 0;
+                    BT_RX_INTERRUPT_FLAG_REGISTER &= ~BT_RX_INTERRUPT_FLAG_MASK;
+                }
+                continue;
+            }
+        #endif
+
+        #if BT_ENABLE_LOW_POWER_IDLE
+            // The pin change interrupt also has priority over the timer
+            if (hostStateChangePending && (BT_STATE_INTERRUPT_CONTROL_REGISTER & BT_STATE_INTERRUPT_CONTROL_MASK)) {
+                hostStateChangePending = 0;
+                bt_hostRunISR(BT_STATE_INTERRUPT_VECTOR);
+                continue;
+            }
+        #endif
+
+        if (hostTimerPending && (BT_TIMER_INTERRUPT_MASK_REGISTER & BT_TIMER_INTERRUPT_ENABLE_MASK)) {
+            hostTimerPending = 0;
+            BT_TIMER_INTERRUPT_FLAG_REGISTER &= ~BT_TIMER_INTERRUPT_FLAG_MASK;
+            hostTimerInterruptCount++;
+            bt_hostRunISR(BT_TIMER_INTERRUPT_VECTOR);
+            #if BT_ENABLE_EDGE_TRIGGERED_RX
+                if (BT_RX_INTERRUPT_FLAG_REGISTER & BT_RX_INTERRUPT_FLAG_MASK) {
+                    hostRxEdgePending = 0;
+                    BT_RX_INTERRUPT_FLAG_REGISTER &= ~BT_RX_INTERRUPT_FLAG_MASK;
+                }
+            #endif
+            continue;
+        }
+
+        break;
+    }
+}
+
+// This function runs the simulation until the given time (or until an ISR has run, if wake is 1)
+static void bt_hostRun(const uint64_t end, const uint8_t wake) {
+    uint32_t interrupts = hostInterruptCount;
+
+    while (1) {
+        // Handle everything that happens at the current time
+        bt_hostUpdateState();
+        bt_hostUpdateRx();
+        bt_hostUpdateTx();
+        bt_hostDispatchInterrupts();
+        // The ISRs may have changed the TX line
+        bt_hostUpdateTx();
+
+        if (hostCycles >= end || (wake && hostInterruptCount != interrupts))
+            break;
+
+        // Jump to the next event
+        uint64_t next = end;
+        uint64_t untilCompare = bt_hostCyclesUntilCompare();
+        if (untilCompare < next - hostCycles)
+            next = hostCycles + untilCompare;
+        if (hostRxBit >= 0 && hostRxNextChange < next)
+            next = hostRxNextChange;
+        if (hostTxBit >= 0 && hostTxNextSample < next)
+            next = hostTxNextSample;
+        if (!hostConnected && hostStateNextToggle < next)
+            next = hostStateNextToggle;
+        // (events that are already due still need time to pass for the timer)
+        if (next <= hostCycles)
+            next = hostCycles + 1;
+
+        bt_hostAdvanceTimer(next - hostCycles);
+        hostCycles = next;
+    }
+}
+
+/*
+ * -----------------------------
+ * Simulation harness functions:
+ * -----------------------------
+ */
+
+void bt_hostAdvance(uint32_t cycles) {
+    bt_hostRun(hostCycles + cycles, 0);
+}
+
+void bt_hostWait() {
+    bt_hostAdvance(BT_HOST_WAIT_CYCLES);
+}
+
+void bt_hostSleep() {
+    uint64_t start = hostCycles;
+    bt_hostRun(hostCycles + F_CPU, 1);
+    hostSleepCycles += hostCycles - start;
+}
+
+uint64_t bt_hostSleepCycles() {
+    return hostSleepCycles;
+}
+
+uint32_t bt_hostTimerInterrupts() {
+    return hostTimerInterruptCount;
+}
+
+uint64_t bt_hostCycles() {
+    return hostCycles;
+}
+
+size_t bt_hostSendBytes(const uint8_t* bytes, size_t length) {
+    // Queue as many bytes as fit
+    size_t queued = 0;
+    while (queued < length && hostRxQueueCount < BT_HOST_QUEUE_LENGTH) {
+        hostRxQueue[(hostRxQueueHead + hostRxQueueCount) % BT_HOST_QUEUE_LENGTH] = bytes[queued++];
+        hostRxQueueCount++;
+    }
+    return queued;
+}
+
+uint8_t bt_hostRxIdle() {
+    return hostRxBit < 0 && hostRxQueueCount == 0;
+}
+
+void bt_hostSetRx(uint8_t level) {
+    bt_hostDriveRx(level != 0);
+}
+
+size_t bt_hostReadTx(uint8_t* buffer, size_t length) {
+    size_t count = 0;
+    while (count < length && hostTxQueueCount > 0) {
+        buffer[count++] = hostTxQueue[hostTxQueueHead];
+        hostTxQueueHead = (hostTxQueueHead + 1) % BT_HOST_QUEUE_LENGTH;
+        hostTxQueueCount--;
+    }
+    return count;
+}
+
+void bt_hostSetTxHandler(void (*handler)(uint8_t byte)) {
+    hostTxHandler = handler;
+}
+
+uint32_t bt_hostTxFramingErrors() {
+    return hostTxFramingErrorCount;
+}
+
+void bt_hostSetLineBaudRate(uint32_t baudRate) {
+    hostLineBaudRate = baudRate;
+}
+
+void bt_hostSetConnected(uint8_t connected) {
+    hostConnected = connected != 0;
+
+    // Start toggling the State line again from low
+    if (!hostConnected) {
+        bt_hostDriveState(0);
+        hostStateNextToggle = hostCycles + F_CPU / 2;
+    }
+}
+
+#endif
@@ -0,0 +1,227 @@
+/*
+ * This file contains the headers/prototypes for the host simulation
+ * backend of the Bluetooth library.
+ *
+ * When BT_HOST_SIMULATION is set to 1 (normally from the compiler command
+ * line, using -DBT_HOST_SIMULATION=1), the library can be built for a normal
+ * computer instead of an AVR.  The AVR registers and interrupt macros are
+ * replaced by the virtual ones below, and bluetooth_host.c simulates the
+ * timer, the external interrupt, and the RX/TX/State lines of the Bluetooth
+ * module cycle-by-cycle, so the library can be tested without any hardware.
+ *
+ * Since nothing runs in the background on the host, time only passes when
+ * bt_hostAdvance() is called.  Library functions that wait for the UART
+ * interrupt (e.g. bt_drain() or bt_awaitAvailable()) advance the simulation
+ * on their own while they wait (or, with BT_ENABLE_LOW_POWER_IDLE, sleep
+ * until the next interrupt using bt_hostSleep()).
+ */
+
+#ifndef BLUETOOTH_HOST_H
+#define BLUETOOTH_HOST_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "bluetooth_settings.h"
+
+// The simulation only covers the software UART
+#if BT_ENABLE_HARDWARE_UART
+    #error "The host simulation does not support BT_ENABLE_HARDWARE_UART."
+#endif
+
+/*
+ *   ___              _       _
+ *  | _ \ ___  __ _  (_) ___ | |_  ___  _ _  ___
+ *  |   // -_)/ _` | | |(_-< |  _|/ -_)| '_|(_-<
+ *  |_|_\\___|\__, | |_|/__/  \__|\___||_|  /__/
+ *            |___/
+ *
+ *                (Virtual Registers)
+ */
+
+// Define the virtual registers used by the default pins and timer in bluetooth_settings.h
+extern volatile uint8_t SREG;
+extern volatile uint8_t PIND, DDRD, PORTD;
+extern volatile uint8_t TCCR0A, TCCR0B, TCNT0, OCR0A, TIMSK0, TIFR0;
+extern volatile uint8_t EICRA, EIMSK, EIFR;
+extern volatile uint8_t PCICR, PCMSK2;
+
+// Define the bit positions used with the virtual registers
+#define PD0 0
+#define PD1 1
+#define PD2 2
+#define PD3 3
+#define PD4 4
+#define PD5 5
+#define PD6 6
+#define PD7 7
+
+#define WGM00  0
+#define WGM01  1
+#define CS00   0
+#define CS01   1
+#define CS02   2
+#define OCIE0A 1
+#define OCF0A  1
+
+#define ISC10 2
+#define ISC11 3
+#define INT0  0
+#define INT1  1
+#define INTF0 0
+#define INTF1 1
+
+#define PCIE2   2
+#define PCINT20 4
+
+// Define the interrupt macros (interrupts are enabled by the I-bit of SREG, like on an AVR)
+#define ISR(vector) void vector(void)
+#define sei()       (SREG |= 0x80)
+#define cli()       (SREG &= ~0x80)
+
+// Define the sleep macros (the sleep mode is ignored, and the simulated CPU sleeps until the next interrupt)
+#define SLEEP_MODE_IDLE      0
+#define set_sleep_mode(mode) ((void) (mode))
+#define sleep_enable()
+#define sleep_disable()
+#define sleep_cpu()          bt_hostSleep()
+
+/*
+ *   _  _
+ *  | || | __ _  _ _  _ _   ___  ___ ___
+ *  | __ |/ _` || '_|| ' \ / -_)(_-<(_-<
+ *  |_||_|\__,_||_|  |_||_|\___|/__//__/
+ *
+ *                (Simulation Harness)
+ */
+
+// Define the number of bytes that can be queued on the virtual RX line, or decoded from the virtual TX line
+#define BT_HOST_QUEUE_LENGTH 256
+
+// Define the number of cycles that library functions advance the simulation by each time they wait
+#define BT_HOST_WAIT_CYCLES (F_CPU / 100000)
+
+/**
+ * This function advances the simulation by the given number of CPU cycles.
+ *
+ * During this time, the virtual timer counts, the RX and State lines
+ * change as scheduled, the TX line is decoded, and interrupt service
+ * routines run whenever their interrupts are enabled and pending.
+ *
+ * @param cycles the number of CPU cycles (at F_CPU) to advance by
+ */
+void bt_hostAdvance(uint32_t cycles);
+
+/**
+ * This function advances the simulation by a short amount of time
+ * (BT_HOST_WAIT_CYCLES).  It is used by library functions that wait
+ * for the UART interrupt to do something.
+ */
+void bt_hostWait();
+
+/**
+ * This function simulates the CPU sleeping until the next interrupt.  The
+ * simulation advances until an interrupt service routine has run (or for
+ * up to one second, if nothing happens, since an AVR would sleep forever).
+ */
+void bt_hostSleep();
+
+/**
+ * This function determines how long the simulated CPU has spent sleeping
+ * in bt_hostSleep().
+ *
+ * @returns the number of CPU cycles spent sleeping so far
+ */
+uint64_t bt_hostSleepCycles();
+
+/**
+ * This function determines how many times the timer interrupt has run
+ * (each run wakes the CPU on an AVR).
+ *
+ * @returns the number of timer interrupts so far
+ */
+uint32_t bt_hostTimerInterrupts();
+
+/**
+ * This function determines how long the simulation has been running.
+ *
+ * @returns the number of CPU cycles simulated so far
+ */
+uint64_t bt_hostCycles();
+
+/**
+ * This function queues bytes to be sent to the library on the virtual RX
+ * line, as if they were sent by the Bluetooth module.  The bytes are sent
+ * back-to-back at the line baud rate (see bt_hostSetLineBaudRate()).
+ *
+ * @param bytes the bytes to send
+ * @param length the number of bytes to send
+ * @returns the number of bytes queued (limited by BT_HOST_QUEUE_LENGTH)
+ */
+size_t bt_hostSendBytes(const uint8_t* bytes, size_t length);
+
+/**
+ * This function determines if all bytes queued using bt_hostSendBytes()
+ * have been sent on the virtual RX line.
+ *
+ * @returns 1 if the RX line is idle, 0 otherwise
+ */
+uint8_t bt_hostRxIdle();
+
+/**
+ * This function sets the level of the virtual RX line directly (e.g. to
+ * simulate noise).  It should not be used while bytes queued using
+ * bt_hostSendBytes() are being sent.
+ *
+ * @param level 1 for high, 0 for low
+ */
+void bt_hostSetRx(uint8_t level);
+
+/**
+ * This function reads bytes that the library has sent on the virtual
+ * TX line.
+ *
+ * @param buffer the pre-allocated buffer where the bytes will be stored
+ * @param length the length of the pre-allocated buffer provided to this function
+ * @returns the number of bytes read
+ */
+size_t bt_hostReadTx(uint8_t* buffer, size_t length);
+
+/**
+ * This function sets a handler that is called each time a byte is decoded
+ * from the virtual TX line (e.g. to simulate the Bluetooth module replying
+ * to AT commands using bt_hostSendBytes()).  Bytes passed to the handler
+ * are not stored for bt_hostReadTx().
+ *
+ * @param handler the handler to call, or NULL to store bytes for bt_hostReadTx() instead
+ */
+void bt_hostSetTxHandler(void (*handler)(uint8_t byte));
+
+/**
+ * This function determines how many bytes decoded from the virtual TX
+ * line had an invalid stop bit.
+ *
+ * @returns the number of framing errors seen on the TX line
+ */
+uint32_t bt_hostTxFramingErrors();
+
+/**
+ * This function sets the baud rate that the simulated Bluetooth module
+ * uses for the virtual RX and TX lines (BT_BAUD_RATE by default).  This
+ * can be set slightly off of the library's baud rate to test how much
+ * clock error the UART can tolerate.
+ *
+ * @param baudRate the baud rate to use
+ */
+void bt_hostSetLineBaudRate(uint32_t baudRate);
+
+/**
+ * This function sets the connection status shown on the virtual State
+ * line.  Like the Bluetooth module, the line is held high while connected,
+ * and alternates high/low every 0.5sec while disconnected.
+ *
+ * @param connected 1 to simulate a connected remote device, 0 otherwise
+ */
+void bt_hostSetConnected(uint8_t connected);
+
+#endif // BLUETOOTH_HOST_H
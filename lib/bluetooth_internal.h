@@ -9,7 +9,11 @@
 #include <stdint.h>
 
 #include "bluetooth_settings.h"
+#include "bluetooth_ringbuffer.h"
 #include "bluetooth.h"
+#if BT_HOST_SIMULATION
+    #include "bluetooth_host.h"
+#endif
 
 /*
  *    ___                 _               _                          _     __  __                         
@@ -28,17 +32,78 @@
 // Define the length of the AT command response buffer
 #define BT_AT_RESPONSE_BUFFER_LENGTH 30
 
-// Define the names of connection/disconnection handler functions
+// Define the steps of an AT command started using bt_atBegin()/bt_atBeginQuery()
+#define BT_AT_STATE_IDLE      0
+#define BT_AT_STATE_SENDING   1
+#define BT_AT_STATE_AWAITING  2
+#define BT_AT_STATE_RECEIVING 3
+#define BT_AT_STATE_SETTLING  4
+#define BT_AT_STATE_DONE      5
+
+// Define the options for an AT command started using bt_atStart()
+// BT_AT_FLAG_NOTIFY calls the callback set by bt_atSetCallback() when the command completes
+// BT_AT_FLAG_NO_SETTLE completes the command without waiting for the change to take effect
+#define BT_AT_FLAG_NOTIFY    (1 << 0)
+#define BT_AT_FLAG_NO_SETTLE (1 << 1)
+
+// Define the settings that can be collected by the bt_config* functions
+#define BT_CONFIG_SETTING_NAME                (1 << 0)
+#define BT_CONFIG_SETTING_PIN                 (1 << 1)
+#define BT_CONFIG_SETTING_AUTHENTICATION_TYPE (1 << 2)
+#define BT_CONFIG_SETTING_MAC_ADDRESS         (1 << 3)
+#define BT_CONFIG_SETTING_ALL                 0x0F
+
+// Define the events that can be queued for bt_processEvents()
+#define BT_EVENT_CONNECTION    1
+#define BT_EVENT_DISCONNECTION 2
+
+// Double-check that the software timers fit in the bits of the mask used to track them
+#if BT_ENABLE_SOFTWARE_TIMERS && ((BT_SOFTWARE_TIMER_COUNT < 1) || (BT_SOFTWARE_TIMER_COUNT > 8))
+    #error "BT_SOFTWARE_TIMER_COUNT must be between 1 and 8."
+#endif
+
+// Double-check that the event queue length can be used by a ring buffer
+#if BT_ENABLE_DEFERRED_EVENTS && (!BT_RING_IS_POWER_OF_TWO(BT_EVENT_QUEUE_LENGTH) || (BT_EVENT_QUEUE_LENGTH > 128))
+    #error "BT_EVENT_QUEUE_LENGTH must be a power of two (up to 128)."
+#endif
+
+// Define the names of connection/disconnection/receive handler functions
 #define BT_CONNECTION_HANDLER    bt_handler_onConnection
 #define BT_DISCONNECTION_HANDLER bt_handler_onDisconnection
+#define BT_RECEIVE_HANDLER       bt_handler_onReceive
 
-// Declare prototypes for connection/disconnection handlers if they're enabled
+// Declare prototypes for connection/disconnection/receive handlers if they're enabled
 #if BT_ENABLE_CONNECTION_HANDLER
     BT_ON_CONNECTION;
 #endif
 #if BT_ENABLE_DISCONNECTION_HANDLER
     BT_ON_DISCONNECTION;
 #endif
+#if BT_ENABLE_RECEIVE_HANDLER
+    BT_ON_RECEIVE;
+#endif
+
+// Allow for the configuration function toggle
+#if BT_ENABLE_CONFIGURATION_FUNCTIONS
+
+    /**
+     * This function starts carrying out an AT command using bt_atPoll().
+     * 
+     * @param command the command to send to the module
+     * @param expected the response expected (or the prefix expected, for queries)
+     * @param queryBuffer the buffer to store the response to a query in (or NULL if the command isn't a query)
+     * @param queryBufferLength the length of the query buffer
+     * @param flags the options for the command (see BT_AT_FLAG_*)
+     * @returns 1 if the command was started, 0 if another command is in progress or the module is connected to a remote device
+     */
+    uint8_t bt_atStart(const char* command, const char* expected, char* queryBuffer, size_t queryBufferLength, uint8_t flags);
+
+#endif
+
+// Detecting the baud rate uses AT commands, so it needs the configuration functions
+#if BT_ENABLE_AUTO_BAUD_RATE && !BT_ENABLE_CONFIGURATION_FUNCTIONS
+    #error "BT_ENABLE_AUTO_BAUD_RATE requires BT_ENABLE_CONFIGURATION_FUNCTIONS."
+#endif
 
 // Define a macro to determine the minimum of two values
 #define min(X,Y) (((X) < (Y)) ? (X) : (Y))
@@ -56,29 +121,92 @@
  */
 
 // Define timer settings (extrapolate from user-provided values)
-// Timer must tick at 3x baud rate
-#define BT_TIMER_TOP ((F_CPU / BT_TIMER_PRESCALE_VALUE / BT_BAUD_RATE / 3) - 1)
+#if BT_ENABLE_HARDWARE_UART
+    // The USART handles the data itself, so the timer only needs
+    // to tick often enough for timeouts and state checks
+    #define BT_TIMER_TICK_RATE BT_TIMER_HARDWARE_UART_TICK_RATE
+#else
+    // Timer must tick at 3x baud rate
+    #define BT_TIMER_TICK_RATE (BT_BAUD_RATE * 3)
+#endif
+// Define the timer compare value (rounded to the nearest value, like the one calculated by bt_setUARTBaudRate())
+#define BT_TIMER_TOP ((((F_CPU / BT_TIMER_PRESCALE_VALUE) + (BT_TIMER_TICK_RATE / 2)) / BT_TIMER_TICK_RATE) - 1)
 // Double-check that the max timer value fits in the timer's bit width
 #if (BT_TIMER_TOP > BT_TIMER_MAXIMUM_VALUE)
     #warning "Timer interval required for baud rate exceeds maximum possible value.  Use a wider timer."
 #endif
 
+// Allow for the edge-triggered receiver toggle
+#if BT_ENABLE_EDGE_TRIGGERED_RX
+    // The edge-triggered receiver replaces the polling receiver, so it can't be used with the USART
+    #if BT_ENABLE_HARDWARE_UART
+        #error "BT_ENABLE_EDGE_TRIGGERED_RX cannot be used with BT_ENABLE_HARDWARE_UART."
+    #endif
+
+    // While idling, the timer ticks once every millisecond
+    #define BT_TIMER_IDLE_TICK_RATE 1000
+    #define BT_TIMER_IDLE_TOP ((F_CPU / BT_TIMER_IDLE_PRESCALE_VALUE / BT_TIMER_IDLE_TICK_RATE) - 1)
+    // Double-check that the idle timer value fits in the timer's bit width
+    #if (BT_TIMER_IDLE_TOP > BT_TIMER_MAXIMUM_VALUE)
+        #warning "Timer interval required for the idle rate exceeds maximum possible value.  Use a larger idle prescaler."
+    #endif
+#endif
+
+// Allow for the low power idle toggle
+#if BT_ENABLE_LOW_POWER_IDLE
+    // The timer can only be stopped if start bits are detected by the RX pin's interrupt
+    #if !BT_ENABLE_EDGE_TRIGGERED_RX
+        #error "BT_ENABLE_LOW_POWER_IDLE requires BT_ENABLE_EDGE_TRIGGERED_RX."
+    #endif
+
+    // Define the number of milliseconds the timer keeps running for after the millisecond counter is read
+    // (functions waiting for a timeout read it each time they wake up, so the timer runs until they're done)
+    #define BT_UART_CLOCK_HOLD_MS 2
+#endif
+
+// Allow for the majority voting toggle
+#if BT_ENABLE_MAJORITY_VOTING
+    // The USART handles the data itself, so it can't use the software UART's receiver
+    #if BT_ENABLE_HARDWARE_UART
+        #error "BT_ENABLE_MAJORITY_VOTING cannot be used with BT_ENABLE_HARDWARE_UART."
+    #endif
+
+    // Each bit is decided one tick after its middle, once the sample after the middle has been taken
+    #define BT_UART_RX_VOTE_DELAY 1
+#else
+    #define BT_UART_RX_VOTE_DELAY 0
+#endif
+
+// Define the USART baud rate register value (using double-speed mode, rounded to the nearest value)
+#define BT_USART_BAUD_VALUE ((((F_CPU / 8) + (BT_BAUD_RATE / 2)) / BT_BAUD_RATE) - 1)
+
+// Define the largest difference (as a percentage) allowed between a baud rate passed to
+// bt_setUARTBaudRate() and the rate that the timer (or USART) can actually produce
+#define BT_UART_MAX_BAUD_ERROR_PERCENT 2
+
+// Define the number of CPU cycles between idle timer ticks (used to check ISR timing)
+// (the number of cycles between bit rate ticks changes with the baud rate, so it's calculated as needed)
+#if BT_ENABLE_EDGE_TRIGGERED_RX
+    #define BT_ISR_IDLE_BUDGET_CYCLES ((BT_TIMER_IDLE_TOP + 1) * BT_TIMER_IDLE_PRESCALE_VALUE)
+#endif
+
 // Define bit widths of UART input/output
 #define BT_UART_TX_BITS 10
 #define BT_UART_RX_BITS 8
 
-// Define size of the UART receiver buffer
-#define BT_UART_RX_BUFFER_LENGTH 32
-
-// Define the number of ticks required for bt_awaitAvailable() to
-// wait the number of milliseconds specified by BT_UART_PACKET_WAIT_MS
-#define BT_UART_PACKET_WAIT_TICKS (((F_CPU / BT_TIMER_PRESCALE_VALUE / BT_TIMER_TOP) * BT_UART_PACKET_WAIT_MS) / 1000)
+// Double-check that the UART buffer lengths can be used by the ring buffers
+#if !BT_RING_IS_POWER_OF_TWO(BT_UART_RX_BUFFER_LENGTH) || (BT_UART_RX_BUFFER_LENGTH > 32768)
+    #error "BT_UART_RX_BUFFER_LENGTH must be a power of two (up to 32768)."
+#endif
+#if !BT_RING_IS_POWER_OF_TWO(BT_UART_TX_BUFFER_LENGTH) || (BT_UART_TX_BUFFER_LENGTH > 32768)
+    #error "BT_UART_TX_BUFFER_LENGTH must be a power of two (up to 32768)."
+#endif
 
-// Define the number of ticks required between state checks to allow for 0.25sec intervals
-#define BT_UART_STATE_CHECK_TICKS (((F_CPU / BT_TIMER_PRESCALE_VALUE / BT_TIMER_TOP) * 250) / 1000)
+// Define the number of milliseconds between state checks (0.25sec intervals)
+#define BT_UART_STATE_CHECK_MS 250
 
-// Define the number of ticks required for 1ms to pass
-#define BT_UART_MILLISECOND_TICKS ((F_CPU / BT_TIMER_PRESCALE_VALUE / BT_TIMER_TOP) / 1000)
+// Define the number of ticks required for 1ms to pass at BT_BAUD_RATE (rounded to the nearest tick)
+#define BT_UART_MILLISECOND_TICKS (((F_CPU / BT_TIMER_PRESCALE_VALUE / (BT_TIMER_TOP + 1)) + 500) / 1000)
 
 // Define macros to turn on/off the UART TX pin, and to get the UART RX pin state
 #define bt_uartSetTxLow()  (BT_TX_PORT &= ~(1 << BT_TX_BIT))
@@ -86,6 +214,16 @@
 #define bt_uartGetRx()     (BT_RX_PIN & (1 << BT_RX_BIT))
 #define bt_uartGetState()  (BT_STATE_PIN & (1 << BT_STATE_BIT))
 
+// Define a macro that runs inside loops that wait for the UART interrupt to do something
+// (nothing runs in the background in the host simulation, so it advances the simulation instead)
+#if BT_ENABLE_LOW_POWER_IDLE
+    #define bt_uartWait() bt_uartSleep()
+#elif BT_HOST_SIMULATION
+    #define bt_uartWait() bt_hostWait()
+#else
+    #define bt_uartWait()
+#endif
+
 /**
  * This function initializes the pins required for the software UART stream.
  */
@@ -97,12 +235,64 @@ void bt_initializeUARTPins();
  */
 void bt_initializeUARTTimer();
 
+// Allow for the hardware USART toggle
+#if BT_ENABLE_HARDWARE_UART
+
+    /**
+     * This function sets up the baud rate, frame format, and interrupts
+     * required for the hardware USART.
+     */
+    void bt_initializeUSART();
+
+#endif
+
 /**
  * This function initializes the software UART stream and sets up the pins
  * and interrupts required.
  */
 void bt_initializeUART();
 
+/**
+ * This function determines how the UART stream's timer (or the USART)
+ * needs to be set up to produce a baud rate.
+ * 
+ * @param baudRate the baud rate to produce
+ * @returns the timer compare value + 1 (or the USART baud rate register value + 1), or 0 if the baud rate can't be produced closely enough
+ */
+uint32_t bt_uartBaudRateDivisor(const uint32_t baudRate);
+
+// Allow for the statistics toggle
+#if BT_ENABLE_STATISTICS
+
+    /**
+     * This function counts an AT command that timed out waiting for
+     * a response (see bt_getStats()).
+     */
+    void bt_statsATTimeout();
+
+#endif
+
+/**
+ * This function determines if the Bluetooth module has stopped sending
+ * data (nothing is being received, and nothing has been received for
+ * BT_UART_PACKET_WAIT_MS).
+ * 
+ * @returns 1 if the module has stopped sending data, 0 otherwise
+ */
+uint8_t bt_uartReceiverIdle();
+
+// Allow for the low power idle toggle
+#if BT_ENABLE_LOW_POWER_IDLE
+
+    /**
+     * This function puts the CPU to sleep until the next interrupt, as long
+     * as the UART timer is running (if it has been stopped, it returns right
+     * away, since there may not be another interrupt).
+     */
+    void bt_uartSleep();
+
+#endif
+
 // Allow for the complex object read/write function toggle
 #if BT_ENABLE_COMPLEX_OBJECT_RX_TX_FUNCTIONS
 
@@ -127,6 +317,99 @@ void bt_initializeUART();
      */
     void bt_readOrderedBytes(uint8_t* bytes, const size_t byteCount);
 
+    // Define the bits of each byte of a variable-length integer (see bt_writeVarUInt32())
+    #define BT_VARINT_PAYLOAD_MASK  0x7F
+    #define BT_VARINT_CONTINUE_MASK 0x80
+
+    // Double-check that the record length fits in the packed length
+    #if BT_RECORD_MAX_LENGTH < 1 || BT_RECORD_MAX_LENGTH > 255
+        #error "BT_RECORD_MAX_LENGTH must be between 1 and 255."
+    #endif
+
+    // Records are packed straight from memory, so work out whether the bytes of each integer
+    // field need to be reversed (AVR stores the least significant byte first, as do most
+    // computers running the host simulation)
+    #if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        #define BT_RECORD_REVERSE_BYTES (BT_UART_ENDIANNESS == 1)
+    #else
+        #define BT_RECORD_REVERSE_BYTES (BT_UART_ENDIANNESS == 0)
+    #endif
+
+#endif
+
+// Allow for the compression function toggle
+#if BT_ENABLE_COMPRESSION_FUNCTIONS
+
+    // The compression functions are part of the complex object read/write functions (next to bt_writeString())
+    #if !BT_ENABLE_COMPLEX_OBJECT_RX_TX_FUNCTIONS
+        #error "The compression functions require the complex object read/write functions to be enabled."
+    #endif
+
+    // Double-check that positions in the window fit in a byte
+    #if (BT_COMPRESSION_WINDOW_BITS < 4) || (BT_COMPRESSION_WINDOW_BITS > 8)
+        #error "BT_COMPRESSION_WINDOW_BITS must be between 4 and 8."
+    #endif
+    #if (BT_COMPRESSION_BLOCK_LENGTH < 1) || (BT_COMPRESSION_BLOCK_LENGTH > 255)
+        #error "BT_COMPRESSION_BLOCK_LENGTH must be between 1 and 255."
+    #endif
+
+    // Define the size of the window that repeats are found in
+    #define BT_COMPRESSION_WINDOW_LENGTH (1 << BT_COMPRESSION_WINDOW_BITS)
+    #define BT_COMPRESSION_WINDOW_MASK   (BT_COMPRESSION_WINDOW_LENGTH - 1)
+
+    // Define the lengths of the repeats that can be sent (anything shorter takes fewer bits as literal bytes)
+    #define BT_COMPRESSION_LENGTH_BITS 4
+    #define BT_COMPRESSION_LENGTH_MASK ((1 << BT_COMPRESSION_LENGTH_BITS) - 1)
+    #define BT_COMPRESSION_MIN_MATCH   2
+    #define BT_COMPRESSION_MAX_MATCH   (BT_COMPRESSION_MIN_MATCH + BT_COMPRESSION_LENGTH_MASK)
+
+    // Define the number of bits in each token (a flag bit followed by a literal byte, a repeat, or the end of the stream)
+    #define BT_COMPRESSION_LITERAL_FLAG 0x100
+    #define BT_COMPRESSION_LITERAL_BITS 9
+    #define BT_COMPRESSION_MATCH_BITS   (1 + BT_COMPRESSION_WINDOW_BITS + BT_COMPRESSION_LENGTH_BITS)
+    #define BT_COMPRESSION_END_BITS     (1 + BT_COMPRESSION_WINDOW_BITS)
+
+#endif
+
+// Allow for the batch function toggle
+#if BT_ENABLE_BATCH_FUNCTIONS
+
+    // The batch functions send the first sample of each channel using bt_writeInt16()
+    #if !BT_ENABLE_COMPLEX_OBJECT_RX_TX_FUNCTIONS
+        #error "The batch functions require the complex object read/write functions to be enabled."
+    #endif
+
+    // Double-check that the sample count fits in the header
+    #if (BT_BATCH_MAX_SAMPLES < 1) || (BT_BATCH_MAX_SAMPLES > 255) || (BT_BATCH_MAX_CHANNELS < 1) || (BT_BATCH_MAX_CHANNELS > 255)
+        #error "BT_BATCH_MAX_SAMPLES and BT_BATCH_MAX_CHANNELS must be between 1 and 255."
+    #endif
+
+    // Define the most bits a (zigzag-encoded) difference between two samples can take
+    #define BT_BATCH_MAX_DELTA_BITS 16
+
+#endif
+
+// Allow for the frame function toggle
+#if BT_ENABLE_FRAME_FUNCTIONS
+
+    // Double-check that the frame length fits in the length byte
+    #if (BT_FRAME_MAX_LENGTH < 1) || (BT_FRAME_MAX_LENGTH > 255)
+        #error "BT_FRAME_MAX_LENGTH must be between 1 and 255."
+    #endif
+
+    // Define the byte that starts each frame
+    #define BT_FRAME_DELIMITER 0x7E
+
+    // Define the initial value of the CRC-16 (CCITT) for each frame
+    #define BT_FRAME_CRC_INITIAL 0xFFFF
+
+    // Define the parts of a frame read by bt_receiveFrame()
+    #define BT_FRAME_STATE_DELIMITER 0
+    #define BT_FRAME_STATE_LENGTH    1
+    #define BT_FRAME_STATE_PAYLOAD   2
+    #define BT_FRAME_STATE_CRC_HIGH  3
+    #define BT_FRAME_STATE_CRC_LOW   4
+
 #endif
 
 #endif // BLUETOOTH_INTERNAL_H
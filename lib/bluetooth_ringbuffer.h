@@ -0,0 +1,241 @@
+/*
+ * This file contains the single-producer/single-consumer ring buffer used
+ * by the Bluetooth library for its UART input/output buffers.
+ *
+ * One side of each buffer (the producer) only ever moves the "head" index,
+ * and the other side (the consumer) only ever moves the "tail" index, so a
+ * buffer can be shared between an interrupt service routine and the main
+ * program.  Interrupts only need to be disabled briefly while 16-bit
+ * indexes are moved (see bt_ringStoreIndex()).
+ */
+
+#ifndef BLUETOOTH_RINGBUFFER_H
+#define BLUETOOTH_RINGBUFFER_H
+
+#include <stdint.h>
+
+#include "bluetooth_settings.h"
+
+#if BT_HOST_SIMULATION
+    #include "bluetooth_host.h"
+#else
+    #include <avr/interrupt.h>
+#endif
+
+// Define the type used for ring buffer indexes.  The indexes count up freely
+// (they are only masked when the buffer is accessed), so 8-bit indexes can
+// address buffers of up to 128 bytes, and 16-bit indexes are used above that
+#if (BT_UART_RX_BUFFER_LENGTH > 128) || (BT_UART_TX_BUFFER_LENGTH > 128)
+    typedef uint16_t bt_ring_index;
+    #define BT_RING_WIDE_INDEXES 1
+#else
+    typedef uint8_t bt_ring_index;
+    #define BT_RING_WIDE_INDEXES 0
+#endif
+
+// Define the ring buffer structure
+typedef struct {
+    // The storage for the buffer (its length must be a power of two)
+    volatile uint8_t* buffer;
+    // The length of the buffer minus one (used to wrap the indexes)
+    bt_ring_index mask;
+    // The index of the "write" head of the buffer (only moved by the producer)
+    volatile bt_ring_index head;
+    // The index of the "read" head of the buffer (only moved by the consumer)
+    volatile bt_ring_index tail;
+} bt_ring;
+
+// Define a macro to initialize a ring buffer around a statically-allocated array
+// These can be used as follows:
+//   static bt_ring ring = BT_RING_INITIALIZER(ringStorage);
+#define BT_RING_INITIALIZER(storage) { (storage), (bt_ring_index) (sizeof(storage) - 1), 0, 0 }
+
+// Define a macro to determine if a value is a power of two (for compile-time buffer length checks)
+#define BT_RING_IS_POWER_OF_TWO(X) (((X) > 0) && (((X) & ((X) - 1)) == 0))
+
+/**
+ * This function reads an index that may be moved by the other side of
+ * the buffer.
+ *
+ * 16-bit indexes can't be read in a single instruction on AVR, so they
+ * are read until two consecutive reads agree (which can only happen if
+ * the read wasn't interrupted partway through an update).
+ *
+ * @param index the index to read
+ * @returns the value of the index
+ */
+static inline bt_ring_index bt_ringLoadIndex(const volatile bt_ring_index* index) {
+    #if BT_RING_WIDE_INDEXES
+        bt_ring_index value;
+        do {
+            value = *index;
+        } while (value != *index);
+        return value;
+    #else
+        return *index;
+    #endif
+}
+
+/**
+ * This function moves an index that may be read by the other side of
+ * the buffer.
+ *
+ * 16-bit indexes are written one byte at a time on AVR, so interrupts
+ * are disabled while they are written.  Otherwise an interrupt could see
+ * a half-written index (e.g. 0x0000 or 0x01FF while the index moves from
+ * 0x00FF to 0x0100), and reading it twice wouldn't help since the write
+ * can't continue until the interrupt returns.
+ *
+ * @param index the index to move
+ * @param value the new value of the index
+ */
+static inline void bt_ringStoreIndex(volatile bt_ring_index* index, const bt_ring_index value) {
+    #if BT_RING_WIDE_INDEXES
+        // Save the status register and disable interrupts so the index is written all at once
+        uint8_t sregTemp = SREG;
+        cli();
+        *index = value;
+        SREG = sregTemp;
+    #else
+        *index = value;
+    #endif
+}
+
+/**
+ * This function determines the number of bytes stored in a ring buffer.
+ *
+ * @param ring the ring buffer to check
+ * @returns the number of bytes currently stored
+ */
+static inline bt_ring_index bt_ringCount(const bt_ring* ring) {
+    return (bt_ring_index) (bt_ringLoadIndex(&ring->head) - bt_ringLoadIndex(&ring->tail));
+}
+
+/**
+ * This function determines if a ring buffer has no bytes stored in it.
+ *
+ * @param ring the ring buffer to check
+ * @returns 1 if the buffer is empty, 0 otherwise
+ */
+static inline uint8_t bt_ringEmpty(const bt_ring* ring) {
+    return bt_ringLoadIndex(&ring->head) == bt_ringLoadIndex(&ring->tail);
+}
+
+/**
+ * This function stores a byte in a ring buffer.  It must only be called
+ * by the producer side of the buffer.
+ *
+ * If the buffer is full, the byte is not stored (bytes that are already
+ * stored are never overwritten).
+ *
+ * @param ring the ring buffer to store the byte in
+ * @param byte the byte to store
+ * @returns 1 if the byte was stored, 0 if the buffer is full
+ */
+static inline uint8_t bt_ringPush(bt_ring* ring, const uint8_t byte) {
+    bt_ring_index head = ring->head;
+
+    // If the buffer is full, the byte can't be stored
+    if ((bt_ring_index) (head - bt_ringLoadIndex(&ring->tail)) > ring->mask)
+        return 0;
+
+    // Store the byte before moving the head, so the consumer never sees an unwritten byte
+    ring->buffer[head & ring->mask] = byte;
+    bt_ringStoreIndex(&ring->head, head + 1);
+    return 1;
+}
+
+/**
+ * This function removes the oldest byte from a ring buffer.  It must only
+ * be called by the consumer side of the buffer.
+ *
+ * @param ring the ring buffer to remove the byte from
+ * @param byte the pointer to the location where the byte will be stored
+ * @returns 1 if a byte was removed, 0 if the buffer is empty
+ */
+static inline uint8_t bt_ringPop(bt_ring* ring, uint8_t* byte) {
+    bt_ring_index tail = ring->tail;
+
+    // If the buffer is empty, there's nothing to remove
+    if (tail == bt_ringLoadIndex(&ring->head))
+        return 0;
+
+    // Read the byte before moving the tail, so the producer can't overwrite it first
+    *byte = ring->buffer[tail & ring->mask];
+    bt_ringStoreIndex(&ring->tail, tail + 1);
+    return 1;
+}
+
+/**
+ * This function reads a byte from a ring buffer without removing it.  It
+ * must only be called by the consumer side of the buffer.
+ *
+ * @param ring the ring buffer to read from
+ * @param offset the position of the byte to read (0 is the oldest byte)
+ * @param byte the pointer to the location where the byte will be stored
+ * @returns 1 if the byte was read, 0 if there aren't enough bytes stored
+ */
+static inline uint8_t bt_ringPeek(const bt_ring* ring, const bt_ring_index offset, uint8_t* byte) {
+    bt_ring_index tail = ring->tail;
+
+    // If the offset is past the newest byte, there's nothing to read
+    if (offset >= (bt_ring_index) (bt_ringLoadIndex(&ring->head) - tail))
+        return 0;
+
+    *byte = ring->buffer[(bt_ring_index) (tail + offset) & ring->mask];
+    return 1;
+}
+
+/**
+ * This function finds the largest block of bytes at the start of a ring
+ * buffer that are stored next to each other in memory.  It must only be
+ * called by the consumer side of the buffer.
+ *
+ * The bytes in the block will not change until they are removed using
+ * bt_ringConsume().
+ *
+ * @param ring the ring buffer to check
+ * @param data the pointer to the location where the start of the block will be stored
+ * @returns the number of bytes in the block
+ */
+static inline bt_ring_index bt_ringSpan(const bt_ring* ring, volatile uint8_t** data) {
+    bt_ring_index tail = ring->tail;
+    bt_ring_index count = (bt_ring_index) (bt_ringLoadIndex(&ring->head) - tail);
+    // Stop at the end of the storage (the rest of the bytes wrap around to the start)
+    bt_ring_index untilEnd = (bt_ring_index) (ring->mask - (tail & ring->mask) + 1);
+
+    *data = ring->buffer + (tail & ring->mask);
+    return (count < untilEnd) ? count : untilEnd;
+}
+
+/**
+ * This function removes bytes from the start of a ring buffer without
+ * reading them.  It must only be called by the consumer side of the buffer.
+ *
+ * @param ring the ring buffer to remove the bytes from
+ * @param count the number of bytes to remove (limited to the number of bytes stored)
+ * @returns the number of bytes removed
+ */
+static inline bt_ring_index bt_ringConsume(bt_ring* ring, bt_ring_index count) {
+    bt_ring_index tail = ring->tail;
+    bt_ring_index stored = (bt_ring_index) (bt_ringLoadIndex(&ring->head) - tail);
+
+    // Don't move the tail past the head
+    if (count > stored)
+        count = stored;
+    bt_ringStoreIndex(&ring->tail, tail + count);
+    return count;
+}
+
+/**
+ * This function removes all bytes from a ring buffer.  It must only be
+ * called by the consumer side of the buffer.
+ *
+ * @param ring the ring buffer to empty
+ */
+static inline void bt_ringFlush(bt_ring* ring) {
+    // Move the tail up to the head (the producer may keep adding bytes past it)
+    bt_ringStoreIndex(&ring->tail, bt_ringLoadIndex(&ring->head));
+}
+
+#endif // BLUETOOTH_RINGBUFFER_H
@@ -19,6 +19,14 @@
     #define F_CPU 16000000
 #endif
 
+// Define whether the library is being built for a normal computer using the host simulation
+// backend (bluetooth_host.c) instead of an AVR
+// * This is normally set from the compiler command line (-DBT_HOST_SIMULATION=1), so the
+//   same settings can be used for both builds
+#ifndef BT_HOST_SIMULATION
+    #define BT_HOST_SIMULATION 0
+#endif
+
 // Define the PINX, DDRX, and PX# values for the RX pin
 #define BT_RX_PIN PIND
 #define BT_RX_DDR DDRD
@@ -45,12 +53,90 @@
 #define BT_TIMER_COUNTER_REGISTER        TCNT0
 #define BT_TIMER_INTERRUPT_MASK_REGISTER TIMSK0
 #define BT_TIMER_INTERRUPT_ENABLE_MASK   (1 << OCIE0A)
+#define BT_TIMER_INTERRUPT_FLAG_REGISTER TIFR0
+#define BT_TIMER_INTERRUPT_FLAG_MASK     (1 << OCF0A)
 #define BT_TIMER_CONTROL_REGISTER_A_MASK (1 << WGM01)
 #define BT_TIMER_CONTROL_REGISTER_B_MASK 0
 #define BT_TIMER_PRESCALE_VALUE          8
 #define BT_TIMER_PRESCALER_REG_A_MASK    0
 #define BT_TIMER_PRESCALER_REG_B_MASK    (1 << CS01)
 
+// Define whether start bits should be detected using an external interrupt on the
+// RX pin instead of polling the RX pin at 3x the baud rate
+// * The timer only ticks at 3x the baud rate while a byte is being sent or received.
+//   The rest of the time, it ticks once per millisecond (for timeouts and connection
+//   checks) using the idle prescaler below
+// * BT_RX_PIN/BT_RX_BIT must be the pin for the interrupt below (the default RX pin,
+//   PD3, is INT1 on the ATmega328P).  Pin change interrupts can also be used.
+#define BT_ENABLE_EDGE_TRIGGERED_RX 0
+
+// Define the interrupt and idle timer information used when BT_ENABLE_EDGE_TRIGGERED_RX is enabled
+// * These defaults are for INT1 (triggering on a falling edge), with an idle prescaler of 64
+#define BT_RX_INTERRUPT_VECTOR             INT1_vect
+#define BT_RX_INTERRUPT_CONTROL_REGISTER   EICRA
+#define BT_RX_INTERRUPT_CONTROL_MASK       (1 << ISC11)
+#define BT_RX_INTERRUPT_MASK_REGISTER      EIMSK
+#define BT_RX_INTERRUPT_ENABLE_MASK        (1 << INT1)
+#define BT_RX_INTERRUPT_FLAG_REGISTER      EIFR
+#define BT_RX_INTERRUPT_FLAG_MASK          (1 << INTF1)
+#define BT_TIMER_IDLE_PRESCALE_VALUE       64
+#define BT_TIMER_IDLE_PRESCALER_REG_A_MASK 0
+#define BT_TIMER_IDLE_PRESCALER_REG_B_MASK ((1 << CS01) | (1 << CS00))
+
+// Define whether the library should save power while the link is idle (this requires BT_ENABLE_EDGE_TRIGGERED_RX)
+// * The timer is stopped completely while nothing is being sent or received, and the connection
+//   state can only change with an edge on the State pin.  It starts again on an edge on the RX
+//   or State pin (using the pin change interrupt below), or when a byte is written
+// * The millisecond counter used for timeouts doesn't count while the timer is stopped, so the
+//   timer keeps running for a few milliseconds each time the counter is read
+// * Library functions that wait for the UART interrupt put the CPU to sleep instead of spinning
+#define BT_ENABLE_LOW_POWER_IDLE 0
+
+// Define the State pin interrupt and the sleep mode used when BT_ENABLE_LOW_POWER_IDLE is enabled
+// * These defaults are for the pin change interrupt for PD4 (PCINT20), and the idle sleep mode
+//   (the sleep mode must leave the timer and the interrupts above running)
+#define BT_STATE_INTERRUPT_VECTOR           PCINT2_vect
+#define BT_STATE_INTERRUPT_CONTROL_REGISTER PCICR
+#define BT_STATE_INTERRUPT_CONTROL_MASK     (1 << PCIE2)
+#define BT_STATE_INTERRUPT_MASK_REGISTER    PCMSK2
+#define BT_STATE_INTERRUPT_ENABLE_MASK      (1 << PCINT20)
+#define BT_SLEEP_MODE                       SLEEP_MODE_IDLE
+
+// Define whether the receiver should decide each bit by a majority vote of three samples (taken
+// one tick apart around the middle of the bit) instead of a single sample, ignore start bits that
+// aren't still low at their middle, and drop bytes that don't end with a valid stop bit.  This
+// makes the receiver much less sensitive to noise on the RX line, at the cost of a few cycles on
+// every tick while a byte is being received (only used by the software UART)
+#define BT_ENABLE_MAJORITY_VOTING 0
+
+// Define whether the hardware USART should be used instead of the software UART
+// * When enabled, the Bluetooth module's TX/RX pins must be connected to the USART's
+//   RXD/TXD pins, and the BT_RX_* and BT_TX_* values above are ignored
+// * The timer above is still used for timeouts and connection checks, but it only
+//   ticks at BT_TIMER_HARDWARE_UART_TICK_RATE instead of 3x the baud rate
+#define BT_ENABLE_HARDWARE_UART 0
+
+// Define the USART information used when BT_ENABLE_HARDWARE_UART is enabled
+// * These defaults are for USART0 on the ATmega328P (RXD is PD0, TXD is PD1)
+// * BT_TIMER_HARDWARE_UART_TICK_RATE must be a multiple of 1000, and the resulting
+//   timer interval must fit in BT_TIMER_MAXIMUM_VALUE with the prescaler above
+#define BT_USART_BAUD_REGISTER_HIGH      UBRR0H
+#define BT_USART_BAUD_REGISTER_LOW       UBRR0L
+#define BT_USART_CONTROL_REGISTER_A      UCSR0A
+#define BT_USART_CONTROL_REGISTER_B      UCSR0B
+#define BT_USART_CONTROL_REGISTER_C      UCSR0C
+#define BT_USART_DATA_REGISTER           UDR0
+#define BT_USART_RX_INTERRUPT_VECTOR     USART_RX_vect
+#define BT_USART_UDRE_INTERRUPT_VECTOR   USART_UDRE_vect
+#define BT_USART_DOUBLE_SPEED_MASK       (1 << U2X0)
+#define BT_USART_TX_COMPLETE_MASK        (1 << TXC0)
+#define BT_USART_ENABLE_MASK             ((1 << RXEN0) | (1 << TXEN0) | (1 << RXCIE0))
+#define BT_USART_UDRE_INTERRUPT_MASK     (1 << UDRIE0)
+#define BT_USART_FRAME_FORMAT_MASK       ((1 << UCSZ01) | (1 << UCSZ00))
+#define BT_USART_FRAME_ERROR_MASK        (1 << FE0)
+#define BT_USART_DATA_OVERRUN_MASK       (1 << DOR0)
+#define BT_TIMER_HARDWARE_UART_TICK_RATE 8000
+
 /*
  *    ___              __  _                         _    _            
  *   / __| ___  _ _   / _|(_) __ _  _  _  _ _  __ _ | |_ (_) ___  _ _  
@@ -70,6 +156,26 @@
 #define BT_ENABLE_CONNECTION_HANDLER    0
 #define BT_ENABLE_DISCONNECTION_HANDLER 0
 
+// Define whether the connection and disconnection handlers should be deferred (instead of being called
+// from the UART interrupt, connection changes are queued, and the handlers are called by bt_processEvents())
+// * BT_EVENT_QUEUE_LENGTH must be a power of two (up to 128).  If bt_processEvents() isn't called
+//   before the queue fills up, later connection changes are dropped
+#define BT_ENABLE_DEFERRED_EVENTS 0
+#define BT_EVENT_QUEUE_LENGTH     4
+
+// Define whether software timers should be enabled (callbacks scheduled using bt_startTimer() are counted
+// down by the UART interrupt's millisecond tick, so they don't need a hardware timer of their own)
+// * The callbacks are called from the UART interrupt, or from bt_processEvents() if BT_ENABLE_DEFERRED_EVENTS
+//   is enabled
+// * BT_SOFTWARE_TIMER_COUNT is the number of timers that can be scheduled at once (up to 8)
+#define BT_ENABLE_SOFTWARE_TIMERS 0
+#define BT_SOFTWARE_TIMER_COUNT   4
+
+// Define whether the receive handler should be enabled (it's called as soon as each byte
+// is received, instead of the byte waiting in the input buffer until it's read)
+// If BT_ENABLE_RECEIVE_HANDLER is enabled, BT_ON_RECEIVE { /* ... */ } must be defined
+#define BT_ENABLE_RECEIVE_HANDLER 0
+
 // Define the timeout in milliseconds for connecting/communicating
 // with the Bluetooth module before the library registers a failure/error
 #define BT_TIMEOUT_MS 100
@@ -82,6 +188,33 @@
 //         sends each bit
 #define BT_UART_PACKET_WAIT_MS 50
 
+// Define the size (in bytes) of the buffer used to store incoming data
+// If more data is received than the buffer can hold before it is read,
+// the new data is dropped (data that hasn't been read yet is never overwritten)
+//   Note: This value must be a power of two.  Buffers larger than 128 bytes use
+//         16-bit indexes, which are slightly slower to access
+#define BT_UART_RX_BUFFER_LENGTH 32
+
+// Define the size (in bytes) of the buffer used to queue outgoing data
+// Bytes passed to bt_write() are stored here and sent in the background by the
+// UART interrupt, so bt_write() only blocks if this buffer is full
+//   Note: This value must be a power of two.  Buffers larger than 128 bytes use
+//         16-bit indexes, which are slightly slower to access
+#define BT_UART_TX_BUFFER_LENGTH 32
+
+// Define the maximum number of regions that the transmitter can hold from a single
+// bt_writev() call (if more regions are provided, bt_writev() waits for the first
+// ones to be sent before queuing the rest)
+#define BT_UART_TX_MAX_SEGMENTS 4
+
+// Enable/disable line mode (bt_linesAvailable() and bt_readLine()).  When enabled, the UART
+// interrupt counts each BT_LINE_DELIMITER as it's received, so complete lines can be found
+// without looking through the input buffer or waiting for BT_UART_PACKET_WAIT_MS
+#define BT_ENABLE_LINE_MODE 0
+
+// Define the character that ends each line in line mode
+#define BT_LINE_DELIMITER '\n'
+
 // Define the endian-ness of numbers being read from/written to the UART stream
 //  - 0 is big-endian, so the most significant bytes are read/written first
 //  - 1 is little-endian, so the least significant bytes are read/written first
@@ -93,6 +226,19 @@
 // you don't use any configuration commands)
 #define BT_ENABLE_CONFIGURATION_FUNCTIONS 1
 
+// Enable/disable detecting the Bluetooth module's baud rate in bt_setup() (see bt_detectBaudRate()).
+// When enabled, BT_BAUD_RATE is only used until the module's baud rate has been found, so the
+// library keeps working if the module's baud rate is changed (requires BT_ENABLE_CONFIGURATION_FUNCTIONS)
+#define BT_ENABLE_AUTO_BAUD_RATE 0
+
+// Enable/disable caching of the module's settings (name, PIN, MAC address, and authentication
+// type) by the configuration functions.  When enabled, the bt_get* functions only ask the
+// module for a setting the first time (or after bt_reset()/bt_resetFactoryDefaults()), and the
+// bt_set* functions skip settings that the module already has
+//   Note: If settings are changed using bt_sendATCommand() directly, call
+//         bt_invalidateConfiguration() afterwards so the cache doesn't go stale
+#define BT_ENABLE_CONFIGURATION_CACHE 0
+
 // Enable/disable the "complex" object read/write functions such as bt_writeString(),
 // bt_readString(), bt_writeInt32(), etc. (if these are not used in your program,
 // they can be disabled to free up some flash memory space)
@@ -100,4 +246,58 @@
 // All basic functions will still be available (e.g. bt_read(), bt_write(), bt_available(), etc.)
 #define BT_ENABLE_COMPLEX_OBJECT_RX_TX_FUNCTIONS 1
 
+// Define the maximum number of bytes in a record sent by bt_writeRecord() (up to 255).  The
+// record is packed into a buffer of this size on the stack while it's sent
+#define BT_RECORD_MAX_LENGTH 32
+
+// Enable/disable the frame functions (bt_sendFrame(), bt_receiveFrame(), and bt_awaitFrame()),
+// which send blocks of bytes with a length and CRC so the receiver knows exactly when each
+// block ends (instead of waiting for BT_UART_PACKET_WAIT_MS) and can drop corrupted ones
+#define BT_ENABLE_FRAME_FUNCTIONS 0
+
+// Define the maximum number of bytes in a frame (up to 255).  A buffer of this size
+// is used to hold the frame being received, so it takes up this much RAM
+#define BT_FRAME_MAX_LENGTH 64
+
+// Enable/disable the compression functions (bt_compressBegin(), bt_compressWrite(), bt_compressEnd(),
+// bt_decompressBegin(), bt_decompressRead(), and bt_decompressComplete()), which send a stream of bytes
+// compressed using LZSS (runs of bytes that appeared recently are sent as references back to them), so
+// repetitive data such as logs and text takes fewer bytes to send
+//   Note: This requires BT_ENABLE_COMPLEX_OBJECT_RX_TX_FUNCTIONS to be enabled
+#define BT_ENABLE_COMPRESSION_FUNCTIONS 0
+
+// Define the number of bits used to refer back to recent bytes (between 4 and 8).  The compressor and
+// decompressor each keep the last 2^BT_COMPRESSION_WINDOW_BITS bytes in RAM (128 bytes by default).
+// Larger windows find more repeats, but take longer to search
+//   Note: Both ends of the link must use the same value
+#define BT_COMPRESSION_WINDOW_BITS 7
+
+// Define the number of compressed bytes collected before they're sent (up to 255).  The
+// compressor fills one block while the last one is sent, so it takes up twice this much RAM
+#define BT_COMPRESSION_BLOCK_LENGTH 16
+
+// Enable/disable the batch functions (bt_batchAdd(), bt_sendBatch(), and bt_receiveBatch()), which
+// collect several samples from each channel (e.g. each axis of an accelerometer) and send them at once.
+// Each channel is sent as its first sample followed by the differences between samples, using only as
+// many bits as the largest difference needs, so slowly changing samples take far fewer bytes
+//   Note: This requires BT_ENABLE_COMPLEX_OBJECT_RX_TX_FUNCTIONS to be enabled
+#define BT_ENABLE_BATCH_FUNCTIONS 0
+
+// Define the number of samples collected from each channel before a batch is sent (up to 255), and
+// the maximum number of channels.  Each bt_batch takes up 2 bytes of RAM for each sample of each channel
+#define BT_BATCH_MAX_SAMPLES  16
+#define BT_BATCH_MAX_CHANNELS 3
+
+// Enable/disable the UART statistics (see bt_getStats()).  The UART interrupts count the bytes
+// sent/received, bytes dropped because the input buffer was full, framing errors, and so on,
+// which can be used to choose buffer sizes and baud rates.  This adds a few cycles to each byte
+#define BT_ENABLE_STATISTICS 0
+
+// Enable/disable profiling of the UART timer ISR (see bt_getISRProfile()).  Each pass
+// through the ISR is timed using the timer's own counter, so the worst case for each
+// path can be compared to the time between ticks (which limits how high BT_BAUD_RATE
+// can be set).  This adds a few cycles to every tick, so it should generally only be
+// enabled while testing (on the board itself, or in a simulator such as simavr)
+#define BT_ENABLE_ISR_PROFILING 0
+
 #endif // BLUETOOTH_SETTINGS_H